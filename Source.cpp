@@ -1,9 +1,20 @@
 ﻿#include <iostream>         // cout, cerr
 #include <cstdlib>          // EXIT_FAILURE
+#include <vector>           // vector
+#include <algorithm>        // sort
+#include <cfloat>           // FLT_MAX
+#include <cstddef>          // offsetof
+#include <thread>           // simulation thread
+#include <mutex>            // simulation input hand-off
+#include <condition_variable>
+#include <atomic>
+#include <deque>            // pending mouse look
 #include <GL/glew.h>        // GLEW library
 #include <GLFW/glfw3.h>     // GLFW library
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>      // Image loading Utility functions
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>  // PNG encoding for frame capture
 
 // GLM Math Header inclusions
 #include <glm/glm.hpp>
@@ -12,6 +23,21 @@
 
 #include "meshes.h"
 #include "camera.h"
+#include "gltrace.h"        // optional GL call tracing (build with GL_TRACE)
+#include "culling.h"
+#include "gpudriven.h"
+#include "triplebuffer.h"   // lock-free frame snapshot hand-off
+#include "streambuffer.h"   // persistently mapped per-frame data
+#include "dynamicresolution.h"  // offscreen scene target scaled by GPU frame time
+#include "log.h"            // asynchronous logging
+#include "samplers.h"       // sampler object cache
+#include "texturestreaming.h"  // mip streaming within a texture memory budget
+#include "scenefile.h"      // memory-mapped binary scenes
+#include "stressscene.h"    // generated scenes for scaling tests
+#include "picking.h"        // BVH ray picking
+#include "lightmap.h"       // baked lighting of static objects
+#include "framepacing.h"    // frame limiter, GPU queue depth and input latency
+#include "framecapture.h"   // asynchronous frame recording
 
 using namespace std; // Standard namespace
 
@@ -32,34 +58,303 @@ namespace
 	// Main GLFW window
 	GLFWwindow* gWindow = nullptr;
 
-	// Texture
-	GLuint gTextureId;
-	GLuint gTextureIdBrick;
-	GLuint gTextureIdOttoman;
-	GLuint gTextureIdSilver;
-	GLuint gTextureIdTennis;
-	GLuint gTextureIdWilson;
-
+	// Scene textures, one per texture unit; mips stream in by projected size (F7 cycles the budget)
+	TextureStreamer gTextureStreamer;
+	const size_t TEXTURE_BUDGETS[] = { 64 * 1024 * 1024, 8 * 1024 * 1024, 2 * 1024 * 1024 };
+	int gTextureBudget = 0;
 
 	glm::vec2 gUVScale(5.0f, 5.0f);
 	GLint gTexWrapMode = GL_REPEAT;
 
+	// Sampling state of the scene's texture units, applied through cached sampler objects
+	// (1-4 set the wrap mode of unit 0, F6 toggles trilinear anisotropic filtering)
+	const int SCENE_TEXTURE_UNITS = 6;
+	const int EXTRA_TEXTURE_UNIT = 5;		// overlay blended in by materials with multiple textures
+	SamplerCache gSamplers;
+	SamplerDesc gUnitSamplers[SCENE_TEXTURE_UNITS];
+	bool gAnisotropicFiltering = false;
+
+	// Mip requests without a CPU draw list (GPU-driven path): each frame sweeps the next
+	// MIP_SWEEP_OBJECTS objects, and every texture unit is requested at the largest size seen in the
+	// last full sweep or the one in progress, so the per-frame cost does not grow with the scene
+	const size_t MIP_SWEEP_OBJECTS = 4096;
+	size_t gMipSweepNext = 0;
+	float gMipSweepTexels[SCENE_TEXTURE_UNITS] = {};	// sweep in progress
+	float gMipSweptTexels[SCENE_TEXTURE_UNITS] = {};	// last full sweep
+
 	// Shader program
 	GLuint gSurfaceProgramId;
 	GLuint gLightProgramId;
+	GLuint gDepthProgramId;
+	GLuint gBoundsProgramId;
+	GLuint gLightmappedProgramId;
 
 	Meshes meshes;
 
-	// camera
+	// Primitives from Meshes that the render queue knows how to draw
+	enum MeshKind
+	{
+		MESH_PLANE,
+		MESH_BOX,
+		MESH_SPHERE,
+		MESH_CYLINDER,
+		MESH_PYRAMID4,
+		MESH_KIND_COUNT
+	};
+
+	// Names scene files use for the MeshKind values
+	const char* const MESH_NAMES[MESH_KIND_COUNT] = { "plane", "box", "sphere", "cylinder", "pyramid4" };
+
+	// Scene loaded when none is given on the command line
+	const char* const DEFAULT_SCENE_PATH = "../resources/scenes/default.scene";
+
+	// Command line: [scene] [--stress N [--seed S] [--density D] [--clustered] [--scale MIN MAX]
+	// [--height H] [--materials M] [--textured F] [--multiple F] [--lights L]] [--stats]
+	// [--latency] [--swap-interval N] [--fps-limit F] [--frames-in-flight N] [--record] [--record-format png|y4m] [--record-fps N]
+	struct LaunchOptions
+	{
+		std::string scenePath = DEFAULT_SCENE_PATH;
+		StressSceneOptions stress;			// stress.objects > 0 generates a scene using the scene's textures
+		bool frameStats = false;			// also on with --stress and --latency
+		bool lowLatency = false;			// late latching, one frame in flight, latency report
+		bool setSwapInterval = false;		// otherwise the driver default stays
+		int swapInterval = 0;				// negative for adaptive vsync where supported
+		double frameRateLimit = 0.0;		// 0 for no limit
+		int framesInFlight = -1;			// -1: 1 with --latency, otherwise up to the driver
+		bool record = false;				// start recording with the first frame
+		FrameCapture::Format recordFormat = FrameCapture::CAPTURE_PNG;
+		int recordFps = 60;					// frame rate written into Y4M streams
+	};
+	const char* const STRESS_SCENE_PATH = "stress.scn";
+
+	// Frame cost report every FRAME_STATS_INTERVAL seconds (--stats, --stress)
+	bool gFrameStats = false;
+	const double FRAME_STATS_INTERVAL = 2.0;
+	std::atomic<float> gSimulationStepMs{ 0.0f };
+
+	// Low latency (--latency; F9 toggles late latching): right before the view matrix is written,
+	// the render thread polls events once more and applies the mouse look the simulation has not
+	// consumed yet to the snapshot's camera. Mouse moves are numbered so a snapshot tells which of
+	// them it already contains.
+	FramePacer gFramePacer;
+	bool gLateLatch = false;
+	struct PendingLook
+	{
+		unsigned long long sequence;
+		float x, y;
+		double time;						// FramePacer::Now() when GLFW reported the move
+	};
+	std::deque<PendingLook> gPendingLook;	// GLFW thread: moves newer than the last rendered snapshot
+	unsigned long long gLookSequence = 0;	// GLFW thread: number of the last mouse move
+	unsigned long long gDisplayedLook = 0;	// render thread: last mouse move drawn into a frame
+	unsigned long long gConsumedLook = 0;	// simulation thread: last mouse move applied to gCamera
+
+	// Window events that change render state only record themselves; the render loop applies them
+	// between frames, since late latching polls events in the middle of a frame
+	bool gResizePending = false;
+	int gPendingWidth = 0;
+	int gPendingHeight = 0;
+	bool gPickPending = false;
+
+	// Frame recording (F10 toggles, --record starts with the first frame): takes are written as
+	// capture_NNN_FFFFFF.png or capture_NNN.y4m, and the loop renders continuously while recording
+	FrameCapture gFrameCapture;
+	FrameCapture::Format gRecordFormat = FrameCapture::CAPTURE_PNG;
+	const char* const CAPTURE_PREFIX = "capture";
+
+	// Texture unit and Phong lighting parameters uploaded to the surface shader for one draw
+	struct SurfaceMaterial
+	{
+		GLint textureUnit;
+		bool hasTexture;
+		bool multipleTextures;
+		glm::vec4 objectColor;
+		float ambientStrength;
+		glm::vec3 ambientColor;
+		glm::vec3 light1Color;
+		glm::vec3 light1Position;
+		glm::vec3 light2Color;
+		glm::vec3 light2Position;
+		float specularIntensity1;
+		float highlightSize1;
+		float specularIntensity2;
+		float highlightSize2;
+	};
+
+	// One draw in the scene: light objects use the light shader, everything else the surface shader
+	struct SceneObject
+	{
+		MeshKind mesh;
+		glm::mat4 model;
+		bool isLight;
+		bool isStatic; // never moves; eligible for baked lighting
+		SurfaceMaterial material;
+		glm::vec3 center; // world-space center of the mesh bounds, used for depth sorting
+		glm::vec3 boundsMin; // world-space bounds, used for culling
+		glm::vec3 boundsMax;
+	};
+
+	// Per-object data the shaders read from an SSBO, selected by the draw's base instance (std430 layout)
+	struct ObjectData
+	{
+		glm::mat4 model;
+		glm::vec4 objectColor;
+		glm::vec4 ambient;			// rgb color, a strength
+		glm::vec4 light1Color;
+		glm::vec4 light1Position;
+		glm::vec4 light2Color;
+		glm::vec4 light2Position;
+		glm::vec4 specular;			// intensity1, highlightSize1, intensity2, highlightSize2
+		GLint flags[4];				// hasTexture, multipleTextures, selected
+		glm::vec4 lightmapScaleOffset;	// atlas region of a static object's lightmap chart: scale xy, offset zw
+	};
+
+	// Draw calls that make up one mesh
+	struct MeshDraw
+	{
+		GLenum mode;
+		bool indexed;
+		GLuint first;
+		GLuint count;
+	};
+	const int MAX_MESH_DRAWS = 3;
+
+	std::vector<SceneObject> gSceneObjects; // render thread's copy of the latest snapshot scene
+	std::vector<int> gDrawOrder; // snapshot draw order minus occluded objects, rebuilt per frame
+	std::vector<unsigned char> gUseOcclusionQuery; // per object: drawn through a conditional render this frame
+	std::vector<GLuint> gQueryBoxSlot; // per object: its box in this frame's query box buffer
+	size_t gQueryCount = 0; // objects flagged in gUseOcclusionQuery
+
+	// Left click selects the object under the cursor (the screen center while the cursor is captured);
+	// the surface shaders tint the selected object
+	ScenePicker gPicker;
+	PickMesh gPickMeshes[MESH_KIND_COUNT];
+	int gSelectedObject = -1;
+
+	// Baked lighting (F8 toggles): static objects are drawn from unrolled copies of their meshes that
+	// carry a lightmap chart, with a shader that reads the diffuse lighting from the atlas
+	struct LightmapMesh
+	{
+		GLuint vao = 0;
+		GLuint vbo = 0;
+		GLuint vertexCount = 0;
+	};
+	LightmapMesh gLightmapMeshes[MESH_KIND_COUNT];
+	LightmapBaker gLightmapBaker;
+	std::string gLightmapCachePath;			// next to the binary scene
+	const int LIGHTMAP_TEXTURE_UNIT = 8;
+	bool gBakedLighting = true;
+	std::vector<unsigned char> gHasLightmap; // per object: has a region in the baked atlas
+
+	// Object data SSBO (binding 2) and the 0..N-1 object index buffer behind vertex attribute 3
+	GLuint gObjectDataBuffer = 0;
+	GLuint gObjectIndexBuffer = 0;
+
+	// Uniform locations, looked up once after the programs are linked
+	struct SurfaceUniforms
+	{
+		GLint texture;
+	};
+	SurfaceUniforms gSurfaceUniforms;
+	SurfaceUniforms gLightmappedUniforms;
+	GLint gBoundsBoxSlotLocation;
+
+	// Per-frame camera data every scene program reads from uniform block binding 0 (std140 layout)
+	struct FrameData
+	{
+		glm::mat4 view;
+		glm::mat4 projection;
+		glm::vec4 uvScale;			// xy
+		glm::vec4 viewPosition;		// xyz, camera position in world space
+	};
+
+	// Per-frame dynamic data (frame uniforms, occlusion query boxes) is written here, never uploaded
+	StreamBuffer gStream;
+	const GLsizeiptr STREAM_REGION_BASE_SIZE = 64 * 1024;
+	// Conservative queries per frame; further large occludees are drawn unconditionally
+	const size_t MAX_OCCLUSION_QUERIES = 1024;
+
+	// Depth-only pre-pass followed by a GL_EQUAL shading pass (F1 toggles)
+	bool gDepthPrepass = false;
+
+	// Hi-Z and query based occlusion culling (F2 toggles)
+	OcclusionCuller gOcclusion;
+	bool gOcclusionCulling = true;
+
+	// Compute-shader culling and indirect draw generation (F3 toggles); the simulation thread reads
+	// it to skip building the CPU draw list
+	GpuDrivenRenderer gGpuDriven;
+	std::atomic<bool> gGpuDrivenRendering{ false };
+
+	// Offscreen scene target whose resolution follows the GPU frame time (F5 toggles scaling)
+	DynamicResolution gDynamicResolution;
+
+	// Immutable per-step output of the simulation thread, consumed by the render thread
+	struct FrameSnapshot
+	{
+		unsigned long long frame = 0;
+		glm::mat4 view;
+		glm::mat4 projection;
+		glm::mat4 viewProjection;
+		unsigned sceneVersion = 0;			// objects are only copied into a slot when this changes
+		std::vector<SceneObject> objects;
+		std::vector<int> drawOrder;			// frustum-visible objects: surfaces front to back, then lights
+		bool hasDrawOrder = false;			// false when built for the GPU-driven path, which culls on the GPU
+		Camera camera;						// camera the view was built from, for late latching
+		bool ortho = false;
+		unsigned long long lookSequence = 0;	// last mouse move applied to the camera
+	};
+
+	// Input gathered on the GLFW thread for the next simulation step
+	struct SimulationInput
+	{
+		unsigned moveKeys = 0;				// bit per Camera_Movement held this frame
+		int viewPreset = 0;					// VIEW_PRESET_* requested this frame
+		float mouseX = 0.0f;				// accumulated look offsets
+		float mouseY = 0.0f;
+		float scroll = 0.0f;
+		unsigned long long lookSequence = 0;	// last mouse move in the look offsets
+	};
+	const int VIEW_PRESET_NONE = 0;
+	const int VIEW_PRESET_PERSPECTIVE = 1;
+	const int VIEW_PRESET_ORTHO = 2;
+
+	// Simulation thread: applies input to the camera and scene and publishes a FrameSnapshot per step
+	std::thread gSimulationThread;
+	TripleBuffer<FrameSnapshot> gSnapshots;
+	std::mutex gInputMutex;
+	std::condition_variable gInputCondition;
+	SimulationInput gInput;					// guarded by gInputMutex
+	bool gInputPending = false;				// guarded by gInputMutex
+	bool gSimulationQuit = false;			// guarded by gInputMutex
+	unsigned gUploadedSceneVersion = 0;		// render thread: scene version in the GPU buffers
+
+	// Simulation thread state (only touched before the thread starts and by the thread itself)
+	std::vector<SceneObject> gSimulationScene;
+	unsigned gSceneVersion = 0;
+	unsigned long long gSimulationFrame = 0;
+
+	// camera (simulation thread)
 	Camera gCamera(glm::vec3(0.0f, 5.0f, 8.0f));
+	bool gOrtho = false;
+
+	// mouse (GLFW thread)
 	float gLastX = WINDOW_WIDTH / 2.0f;
 	float gLastY = WINDOW_HEIGHT / 2.0f;
 	bool gFirstMouse = true;
-	bool gOrtho = false;
 
-	// timing
-	float gDeltaTime = 0.0f; // time between current frame and last frame
+	// timing (simulation thread)
+	float gDeltaTime = 0.0f; // time between current step and last step
 	float gLastFrame = 0.0f;
+
+	// On-demand rendering (F4 toggles): the loop sleeps in glfwWaitEventsTimeout until something
+	// requests frames. Each change asks for a few frames so the occlusion results that lag behind
+	// the camera settle before the loop goes idle again.
+	bool gOnDemandRendering = true;
+	int gFramesRequested = 0;
+	const int SETTLE_FRAMES = 4;
+	const double IDLE_WAIT_TIMEOUT = 0.25;		// seconds between wake-ups while idle
+	const float MAX_STEP_DELTA = 1.0f / 30.0f;	// caps the first simulation step after an idle wait
 }
 
 /* User-defined Function prototypes to:
@@ -73,13 +368,85 @@ void UProcessInput(GLFWwindow* window);
 void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos);
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
-bool UCreateTexture(const char* filename, GLuint& textureId);
-void UDestroyTexture(GLuint textureId);
-void URender();
+bool UCreateTexture(const char* filename, int textureUnit);
+void URequestTextureMips(const FrameSnapshot& frame);
+float UProjectedTexels(const FrameSnapshot& frame, const SceneObject& object);
+void URender(const FrameSnapshot& frame);
 bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
+bool UCreateComputeProgram(const char* computeShaderSource, GLuint& programId);
+bool UCreateComputeProgram(const char* const* computeShaderSources, GLsizei count, GLuint& programId);
 void UDestroyShaderProgram(GLuint programId);
+void UCacheUniformLocations();
+bool UParseCommandLine(int argc, char* argv[], LaunchOptions& options);
+void USceneMeshInfo(SceneMeshInfo meshInfo[MESH_KIND_COUNT]);
+bool UOpenScene(const std::string& path, SceneFile& scene);
+bool UOpenStressScene(const LaunchOptions& options, SceneFile& scene);
+void UReportFrameStats(double renderMs);
+bool UReadMeshTriangles(MeshKind mesh, std::vector<glm::vec3>& positions, std::vector<glm::vec3>* normals, std::vector<glm::vec2>* uvs);
+void UBuildPickMeshes();
+void UBuildLightmapMeshes();
+void UPickObject(GLFWwindow* window);
+void USetObjectSelected(int index, bool selected);
+bool UCreateScene(const SceneFile& scene);
+void UBuildDrawOrder(FrameSnapshot& frame);
+void UCullDrawOrder(const FrameSnapshot& frame);
+void UUploadScene();
+void UBakeLightmaps(std::vector<glm::vec4>& scaleOffsets);
+bool UIsLightmapped(size_t objectIndex);
+void UBuildGpuDraws();
+int UMeshDraws(MeshKind mesh, MeshDraw draws[MAX_MESH_DRAWS], bool lightmapped = false);
+void UDrawMesh(MeshKind mesh, GLuint objectIndex, bool lightmapped = false);
+GLuint UMeshVao(MeshKind mesh, bool lightmapped = false);
+void UWriteFrameData(const glm::mat4& view, const glm::mat4& projection);
+void URenderDrawList(const FrameSnapshot& frame);
+void URenderIndirect(const glm::mat4& viewProjection);
+void URequestRedraw(int frames = SETTLE_FRAMES);
+void UWindowRefreshCallback(GLFWwindow* window);
+void UBindUnitSampler(int unit);
+void USetWrapMode(int unit, GLint wrapMode);
+void USetAnisotropicFiltering(bool enabled);
+void UStartSimulation();
+void UStopSimulation();
+void USimulationThread();
+void USimulationStep(const SimulationInput& input);
+void UPublishSnapshot();
+void UPostSimulationInput(const SimulationInput& input);
+double ULatchCamera(const FrameSnapshot& frame, glm::mat4& view);
+void UToggleRecording();
+void UApplyWindowEvents();
+
+
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+/*Per-frame camera data shared by the scene shaders, matches FrameData*/
+#define FRAME_DATA_GLSL GLSL_SOURCE(\
+layout(std140, binding = 0) uniform FrameBlock\
+{\
+	mat4 view;\
+	mat4 projection;\
+	vec4 uvScale;\
+	vec4 viewPosition;\
+};\
+)
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+/*Per-object data shared by the scene shaders, matches ObjectData*/
+#define OBJECT_DATA_GLSL GLSL_SOURCE(\
+struct ObjectData\
+{\
+	mat4 model;\
+	vec4 objectColor;\
+	vec4 ambient;\
+	vec4 light1Color;\
+	vec4 light1Position;\
+	vec4 light2Color;\
+	vec4 light2Position;\
+	vec4 specular;\
+	ivec4 flags;\
+	vec4 lightmapScaleOffset;\
+};\
+layout(std430, binding = 2) readonly buffer ObjectBuffer { ObjectData objects[]; };\
+)
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////
 /* Surface Vertex Shader Source Code*/
@@ -88,24 +455,29 @@ const GLchar* surfaceVertexShaderSource = GLSL(440,
 	layout(location = 0) in vec3 vertexPosition; // VAP position 0 for vertex position data
 layout(location = 1) in vec3 vertexNormal; // VAP position 1 for normals
 layout(location = 2) in vec2 textureCoordinate;
+layout(location = 3) in uint objectIndex; // Per-instance attribute: the draw's base instance selects the object
+
+invariant gl_Position; // Depth must match the depth pre-pass exactly for GL_EQUAL testing
 
 out vec3 vertexFragmentNormal; // For outgoing normals to fragment shader
 out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
 out vec2 vertexTextureCoordinate;
+flat out uint vertexObjectIndex; // For outgoing object index to fragment shader
 
 //Uniform / Global variables for the  transform matrices
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+) FRAME_DATA_GLSL OBJECT_DATA_GLSL GLSL_SOURCE(
 
 void main()
 {
+	mat4 model = objects[objectIndex].model;
+
 	gl_Position = projection * view * model * vec4(vertexPosition, 1.0f); // Transforms vertices into clip coordinates
 
 	vertexFragmentPos = vec3(model * vec4(vertexPosition, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
 
 	vertexFragmentNormal = mat3(transpose(inverse(model))) * vertexNormal; // get normal vectors in world space only and exclude normal translation properties
 	vertexTextureCoordinate = textureCoordinate;
+	vertexObjectIndex = objectIndex;
 }
 );
 ////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -116,30 +488,33 @@ const GLchar* surfaceFragmentShaderSource = GLSL(440,
 	in vec3 vertexFragmentNormal; // For incoming normals
 in vec3 vertexFragmentPos; // For incoming fragment position
 in vec2 vertexTextureCoordinate;
+flat in uint vertexObjectIndex; // For incoming object index
 
 out vec4 fragmentColor; // For outgoing cube color to the GPU
 
-// Uniform / Global variables for object color, light color, light position, and camera/view position
-uniform vec4 objectColor;
-uniform vec3 ambientColor;
-uniform vec3 light1Color;
-uniform vec3 light1Position;
-uniform vec3 light2Color;
-uniform vec3 light2Position;
-uniform vec3 viewPosition;
+// Uniform / Global variables for textures
 uniform sampler2D uTexture; // Useful when working with multiple textures
 uniform sampler2D uTextureExtra;
-uniform vec2 uvScale;
-uniform bool ubHasTexture;
-uniform float ambientStrength; // Set ambient or global lighting strength
-uniform float specularIntensity1;
-uniform float highlightSize1;
-uniform float specularIntensity2;
-uniform float highlightSize2;
-uniform bool multipleTextures;
+) FRAME_DATA_GLSL OBJECT_DATA_GLSL GLSL_SOURCE(
 
 void main()
 {
+	// Object color, light color, light position and material of this object
+	ObjectData object = objects[vertexObjectIndex];
+	vec4 objectColor = object.objectColor;
+	vec3 ambientColor = object.ambient.rgb;
+	float ambientStrength = object.ambient.a; // Set ambient or global lighting strength
+	vec3 light1Color = object.light1Color.rgb;
+	vec3 light1Position = object.light1Position.xyz;
+	vec3 light2Color = object.light2Color.rgb;
+	vec3 light2Position = object.light2Position.xyz;
+	float specularIntensity1 = object.specular.x;
+	float highlightSize1 = object.specular.y;
+	float specularIntensity2 = object.specular.z;
+	float highlightSize2 = object.specular.w;
+	bool ubHasTexture = object.flags.x != 0;
+	bool multipleTextures = object.flags.y != 0;
+
 	/*Phong lighting model calculations to generate ambient, diffuse, and specular components*/
 
 	//Calculate Ambient lighting
@@ -155,7 +530,7 @@ void main()
 	vec3 diffuse2 = impact2 * light2Color; // Generate diffuse light color
 
 	//**Calculate Specular lighting**
-	vec3 viewDir = normalize(viewPosition - vertexFragmentPos); // Calculate view direction
+	vec3 viewDir = normalize(viewPosition.xyz - vertexFragmentPos); // Calculate view direction
 	vec3 reflectDir1 = reflect(-light1Direction, norm);// Calculate reflection vector
 	//Calculate specular component
 	float specularComponent1 = pow(max(dot(viewDir, reflectDir1), 0.0), highlightSize1);
@@ -183,18 +558,18 @@ void main()
 
 		if (multipleTextures == false)
 		{
-			textureColor = texture(uTexture, vertexTextureCoordinate * uvScale);
+			textureColor = texture(uTexture, vertexTextureCoordinate * uvScale.xy);
 			phongResult = phongResult * textureColor;
 		}
 		else
 		{
 			vec4 extraTexture = texture(uTextureExtra, vertexTextureCoordinate);
 			if (extraTexture.a != 0.0) {
-				textureColor = texture(uTextureExtra, vertexTextureCoordinate * uvScale);
+				textureColor = texture(uTextureExtra, vertexTextureCoordinate * uvScale.xy);
 				phongResult = textureColor;
 			}
 			else {
-				textureColor = texture(uTexture, vertexTextureCoordinate * uvScale);
+				textureColor = texture(uTexture, vertexTextureCoordinate * uvScale.xy);
 				phongResult = phongResult * textureColor;
 			}
 		}
@@ -208,6 +583,10 @@ void main()
 		fragmentColor = vec4(phong1 + phong2, 1.0); // Send lighting results to GPU
 	}
 
+	// Picked object
+	if (object.flags.z != 0)
+		fragmentColor.rgb = mix(fragmentColor.rgb, vec3(1.0, 0.8, 0.2), 0.35);
+
 	//fragmentColor = vec4(phong1 + phong2, 1.0); // Send lighting results to GPU
 	//fragmentColor = vec4(1.0f, 1.0f, 1.0f, 1.0f);
 
@@ -217,23 +596,126 @@ void main()
 /////////////////////////////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+/* Lightmapped Surface Vertex Shader Source Code*/
+const GLchar* lightmappedVertexShaderSource = GLSL(440,
+
+	layout(location = 0) in vec3 vertexPosition;
+layout(location = 1) in vec3 vertexNormal;
+layout(location = 2) in vec2 textureCoordinate;
+layout(location = 3) in uint objectIndex; // Per-instance attribute: the draw's base instance selects the object
+layout(location = 4) in vec2 lightmapCoordinate; // Lightmap chart of the mesh
+
+invariant gl_Position; // Depth must match the depth pre-pass exactly for GL_EQUAL testing
+
+out vec3 vertexFragmentNormal;
+out vec3 vertexFragmentPos;
+out vec2 vertexTextureCoordinate;
+out vec2 vertexLightmapCoordinate;
+flat out uint vertexObjectIndex;
+) FRAME_DATA_GLSL OBJECT_DATA_GLSL GLSL_SOURCE(
+
+void main()
+{
+	mat4 model = objects[objectIndex].model;
+
+	gl_Position = projection * view * model * vec4(vertexPosition, 1.0f);
+
+	vertexFragmentPos = vec3(model * vec4(vertexPosition, 1.0f));
+	vertexFragmentNormal = mat3(transpose(inverse(model))) * vertexNormal;
+	vertexTextureCoordinate = textureCoordinate;
+
+	// The chart is placed in the object's region of the atlas
+	vec4 scaleOffset = objects[objectIndex].lightmapScaleOffset;
+	vertexLightmapCoordinate = lightmapCoordinate * scaleOffset.xy + scaleOffset.zw;
+	vertexObjectIndex = objectIndex;
+}
+);
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+/* Lightmapped Surface Fragment Shader Source Code: the surface shader with both diffuse terms read from the atlas*/
+const GLchar* lightmappedFragmentShaderSource = GLSL(440,
+
+	in vec3 vertexFragmentNormal;
+in vec3 vertexFragmentPos;
+in vec2 vertexTextureCoordinate;
+in vec2 vertexLightmapCoordinate;
+flat in uint vertexObjectIndex;
+
+out vec4 fragmentColor;
+
+uniform sampler2D uTexture;
+uniform sampler2D uTextureExtra;
+uniform sampler2D uLightmap; // diffuse1 + diffuse2, baked
+) FRAME_DATA_GLSL OBJECT_DATA_GLSL GLSL_SOURCE(
+
+void main()
+{
+	ObjectData object = objects[vertexObjectIndex];
+	bool ubHasTexture = object.flags.x != 0;
+	bool multipleTextures = object.flags.y != 0;
+
+	//Calculate Ambient lighting, once per light as in the surface shader
+	vec3 ambient = object.ambient.a * object.ambient.rgb;
+
+	//**Diffuse lighting of both lights comes from the lightmap**
+	vec3 diffuse = texture(uLightmap, vertexLightmapCoordinate).rgb;
+
+	//**Calculate Specular lighting**
+	vec3 norm = normalize(vertexFragmentNormal);
+	vec3 viewDir = normalize(viewPosition.xyz - vertexFragmentPos);
+	vec3 light1Direction = normalize(object.light1Position.xyz - vertexFragmentPos);
+	vec3 reflectDir1 = reflect(-light1Direction, norm);
+	float specularComponent1 = pow(max(dot(viewDir, reflectDir1), 0.0), object.specular.y);
+	vec3 specular1 = object.specular.x * specularComponent1 * object.light1Color.rgb;
+	vec3 light2Direction = normalize(object.light2Position.xyz - vertexFragmentPos);
+	vec3 reflectDir2 = reflect(-light2Direction, norm);
+	float specularComponent2 = pow(max(dot(viewDir, reflectDir2), 0.0), object.specular.w);
+	vec3 specular2 = object.specular.z * specularComponent2 * object.light2Color.rgb;
+
+	//**Calculate phong result**, the same sum of both lights as the surface shader
+	vec3 phong = 2.0 * ambient + diffuse + specular1 + specular2;
+
+	if (ubHasTexture == true)
+	{
+		vec4 phongResult = vec4(phong, 1.0);
+		vec4 extraTexture = multipleTextures ? texture(uTextureExtra, vertexTextureCoordinate) : vec4(0.0);
+		if (extraTexture.a != 0.0)
+			phongResult = texture(uTextureExtra, vertexTextureCoordinate * uvScale.xy);
+		else
+			phongResult = phongResult * texture(uTexture, vertexTextureCoordinate * uvScale.xy);
+
+		fragmentColor = phongResult;
+	}
+	else
+	{
+		fragmentColor = vec4(phong * object.objectColor.xyz, 1.0);
+	}
+
+	// Picked object
+	if (object.flags.z != 0)
+		fragmentColor.rgb = mix(fragmentColor.rgb, vec3(1.0, 0.8, 0.2), 0.35);
+}
+);
+/////////////////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 /* Light Object Shader Source Code*/
-const GLchar* lightVertexShaderSource = GLSL(330,
+const GLchar* lightVertexShaderSource = GLSL(440,
 	layout(location = 0) in vec3 aPos;
+layout(location = 3) in uint objectIndex;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+invariant gl_Position;
+) FRAME_DATA_GLSL OBJECT_DATA_GLSL GLSL_SOURCE(
 
 void main()
 {
-	gl_Position = projection * view * model * vec4(aPos, 1.0);
+	gl_Position = projection * view * objects[objectIndex].model * vec4(aPos, 1.0);
 }
 );
 /////////////////////////////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////////////////////////
 /* Light Object Shader Source Code*/
-const GLchar* lightFragmentShaderSource = GLSL(330,
+const GLchar* lightFragmentShaderSource = GLSL(440,
 	out vec4 FragColor;
 
 void main()
@@ -241,6 +723,48 @@ void main()
 	FragColor = vec4(1.0); // set all 4 vector values to 1.0
 }
 );
+/////////////////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////////
+/* Depth Pre-pass Vertex Shader Source Code*/
+const GLchar* depthVertexShaderSource = GLSL(440,
+	layout(location = 0) in vec3 vertexPosition;
+layout(location = 3) in uint objectIndex;
+
+invariant gl_Position;
+) FRAME_DATA_GLSL OBJECT_DATA_GLSL GLSL_SOURCE(
+
+void main()
+{
+	mat4 model = objects[objectIndex].model;
+	gl_Position = projection * view * model * vec4(vertexPosition, 1.0f); // Same transform as the shading pass
+}
+);
+/////////////////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////////
+/* Occlusion Query Bounding Box Vertex Shader Source Code*/
+const GLchar* boundsVertexShaderSource = GLSL(440,
+	layout(location = 0) in vec3 vertexPosition;
+layout(location = 3) in uint objectIndex;
+
+// Box transforms of this frame's queries, written densely to the streaming buffer
+layout(std430, binding = 6) readonly buffer QueryBoxBuffer { mat4 boxes[]; };
+uniform uint boxSlot;
+) FRAME_DATA_GLSL GLSL_SOURCE(
+
+void main()
+{
+	gl_Position = projection * view * boxes[boxSlot] * vec4(vertexPosition, 1.0f);
+}
+);
+/////////////////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////////
+/* Depth Pre-pass Fragment Shader Source Code*/
+const GLchar* depthFragmentShaderSource = GLSL(440,
+void main()
+{
+	// Depth only, color writes are masked off
+}
+);
 
 // Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so let's flip it
 void flipImageVertically(unsigned char* image, int width, int height, int channels)
@@ -264,12 +788,40 @@ void flipImageVertically(unsigned char* image, int width, int height, int channe
 
 int main(int argc, char* argv[])
 {
+	// Log records are written by a background thread from here on
+	ULogger().Start();
+
+	LaunchOptions options;
+	if (!UParseCommandLine(argc, argv, options))
+		return EXIT_FAILURE;
+
+	// Stress runs render continuously so every frame is measured
+	gFrameStats = options.frameStats || options.stress.objects > 0 || options.lowLatency;
+	if (options.stress.objects > 0)
+		gOnDemandRendering = false;
+
 	if (!UInitialize(argc, argv, &gWindow))
 		return EXIT_FAILURE;
 
+	// Frame pacing: swap interval, frame limiter and GPU queue depth
+	if (options.setSwapInterval)
+		glfwSwapInterval(options.swapInterval);
+	gFramePacer.Initialize();
+	gFramePacer.FrameRateLimit = options.frameRateLimit;
+	gFramePacer.MaxFramesInFlight = options.framesInFlight >= 0 ? options.framesInFlight : (options.lowLatency ? 1 : 0);
+	gLateLatch = options.lowLatency;
+	gRecordFormat = options.recordFormat;
+	gFrameCapture.FramesPerSecond = options.recordFps;
+
 	// Create the mesh
 	meshes.CreateMeshes();
 
+	// Triangle BVHs of the meshes for picking
+	UBuildPickMeshes();
+
+	// Copies of the meshes with a lightmap chart, for static objects
+	UBuildLightmapMeshes();
+
 	// camera initialization
 	gCamera.Position = glm::vec3(0.0f, 5.0f, 8.0f);
 	gCamera.Front = glm::vec3(0.0f, -0.5f, -2.0f);
@@ -283,120 +835,286 @@ int main(int argc, char* argv[])
 	if (!UCreateShaderProgram(lightVertexShaderSource, lightFragmentShaderSource, gLightProgramId))
 		return EXIT_FAILURE;
 
-
-	// Load texture
-	const char* texFilename = "../resources/textures/silver4.jpg";
-	if (!UCreateTexture(texFilename, gTextureId))
-	{
-		cout << "Failed to load texture " << texFilename << endl;
+	// Create the shader program
+	if (!UCreateShaderProgram(depthVertexShaderSource, depthFragmentShaderSource, gDepthProgramId))
 		return EXIT_FAILURE;
-	}
 
-	// Load texture
-	texFilename = "../resources/textures/wood.jpg";
-	if (!UCreateTexture(texFilename, gTextureIdBrick))
-	{
-		cout << "Failed to load texture " << texFilename << endl;
-		return EXIT_FAILURE;
-	}
-	// Load texture
-	texFilename = "../resources/textures/ottoman3.jpg";
-	if (!UCreateTexture(texFilename, gTextureIdOttoman))
-	{
-		cout << "Failed to load texture " << texFilename << endl;
-		return EXIT_FAILURE;
-	}
-	// Load texture
-	texFilename = "../resources/textures/silver.jpg";
-	if (!UCreateTexture(texFilename, gTextureIdSilver))
-	{
-		cout << "Failed to load texture " << texFilename << endl;
+	// Create the shader program
+	if (!UCreateShaderProgram(boundsVertexShaderSource, depthFragmentShaderSource, gBoundsProgramId))
 		return EXIT_FAILURE;
-	}
-	// Load texture
-	texFilename = "../resources/textures/tennis_ball3.png";
-	if (!UCreateTexture(texFilename, gTextureIdTennis))
-	{
-		cout << "Failed to load texture " << texFilename << endl;
+
+	// Create the shader program
+	if (!UCreateShaderProgram(lightmappedVertexShaderSource, lightmappedFragmentShaderSource, gLightmappedProgramId))
 		return EXIT_FAILURE;
-	}
-	// Load texture
-	texFilename = "../resources/textures/bandana.png";
-	if (!UCreateTexture(texFilename, gTextureIdWilson))
-	{
-		cout << "Failed to load texture " << texFilename << endl;
+
+	UCacheUniformLocations();
+
+	// Occlusion culling resources
+	if (!gOcclusion.Initialize(WINDOW_WIDTH, WINDOW_HEIGHT))
 		return EXIT_FAILURE;
-	}
 
-	// tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
-	//glUseProgram(gSurfaceProgramId);
-	// We set the texture as texture unit 0
-	//glUniform1i(glGetUniformLocation(gSurfaceProgramId, "uTexture"), 0);
+	// GPU-driven culling resources
+	if (!gGpuDriven.Initialize())
+		return EXIT_FAILURE;
 
-	// bind textures on corresponding texture units
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gTextureId);
+	// Offscreen scene target
+	if (!gDynamicResolution.Initialize(WINDOW_WIDTH, WINDOW_HEIGHT))
+		return EXIT_FAILURE;
 
-	// bind textures on corresponding texture units
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, gTextureIdBrick);
+	glGenBuffers(1, &gObjectDataBuffer);
+	glGenBuffers(1, &gObjectIndexBuffer);
 
-	// bind textures on corresponding texture units
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, gTextureIdOttoman);
+	// Streaming buffer for per-frame data: the frame data plus every query box a frame may write
+	if (!gStream.Initialize(STREAM_REGION_BASE_SIZE + MAX_OCCLUSION_QUERIES * sizeof(glm::mat4)))
+		return EXIT_FAILURE;
 
-	// bind textures on corresponding texture units
-	glActiveTexture(GL_TEXTURE3);
-	glBindTexture(GL_TEXTURE_2D, gTextureIdSilver);
 
-	// bind textures on corresponding texture units
-	glActiveTexture(GL_TEXTURE4);
-	glBindTexture(GL_TEXTURE_2D, gTextureIdTennis);
+	// Map the scene; a text scene is compiled to binary first when that is missing or stale
+	double sceneStart = glfwGetTime();
+	SceneFile sceneFile;
+	if (options.stress.objects > 0 ? !UOpenStressScene(options, sceneFile) : !UOpenScene(options.scenePath, sceneFile))
+		return EXIT_FAILURE;
 
-	// bind textures on corresponding texture units
-	glActiveTexture(GL_TEXTURE5);
-	glBindTexture(GL_TEXTURE_2D, gTextureIdWilson);
+	// Baked lighting is cached next to the binary scene
+	gLightmapCachePath = (options.stress.objects > 0 ? std::string(STRESS_SCENE_PATH) : USceneBinaryPath(options.scenePath)) + ".lmap";
 
+	// Load the scene's textures; each is bound to its texture unit with only its coarse mips resident
+	gTextureStreamer.BudgetBytes = TEXTURE_BUDGETS[gTextureBudget];
+	for (uint32_t i = 0; i < sceneFile.Header().textureCount; ++i)
+	{
+		const SceneFileTexture& texture = sceneFile.Textures()[i];
+		if (texture.unit < 0 || texture.unit >= SCENE_TEXTURE_UNITS || !UCreateTexture(texture.path, texture.unit))
+		{
+			ULOG_ERROR("Failed to load texture %s", texture.path);
+			return EXIT_FAILURE;
+		}
+	}
 	glUseProgram(gSurfaceProgramId);
-	glUniform1i(glGetUniformLocation(gSurfaceProgramId, "uTextureExtra"), 5);
+	glUniform1i(glGetUniformLocation(gSurfaceProgramId, "uTextureExtra"), EXTRA_TEXTURE_UNIT);
+	glUseProgram(gLightmappedProgramId);
+	glUniform1i(glGetUniformLocation(gLightmappedProgramId, "uTextureExtra"), EXTRA_TEXTURE_UNIT);
+	glUniform1i(glGetUniformLocation(gLightmappedProgramId, "uLightmap"), LIGHTMAP_TEXTURE_UNIT);
+
+	// Sampler objects override the textures' own sampling parameters
+	gSamplers.Initialize();
+	const GLfloat borderColor[] = { 1.0f, 0.0f, 1.0f, 1.0f };
+	std::copy(borderColor, borderColor + 4, gUnitSamplers[0].borderColor);
+	for (int unit = 0; unit < SCENE_TEXTURE_UNITS; ++unit)
+		UBindUnitSampler(unit);
+
+	// The lightmap atlas has no mips and is only ever sampled inside the regions
+	SamplerDesc lightmapSampler;
+	lightmapSampler.wrapS = GL_CLAMP_TO_EDGE;
+	lightmapSampler.wrapT = GL_CLAMP_TO_EDGE;
+	glBindSampler(LIGHTMAP_TEXTURE_UNIT, gSamplers.Get(lightmapSampler));
 
 	// Sets the background color of the window to black (it will be implicitely used by glClear)
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
+	// Build the draw list straight from the mapped scene
+	double objectsStart = glfwGetTime();
+	if (!UCreateScene(sceneFile))
+		return EXIT_FAILURE;
+	ULOG_INFO("Scene: %u objects, %u materials, %u textures (objects %.2f ms, total %.2f ms)",
+		sceneFile.Header().objectCount, sceneFile.Header().materialCount, sceneFile.Header().textureCount,
+		(glfwGetTime() - objectsStart) * 1000.0, (glfwGetTime() - sceneStart) * 1000.0);
+	sceneFile.Close();
+
+	// The simulation thread owns the camera and scene from here on
+	UStartSimulation();
+
+	if (options.record)
+		UToggleRecording();
+
 
 	// render loop
 	// -----------
+	bool haveSnapshot = false;
 	while (!glfwWindowShouldClose(gWindow))
 	{
-		// per-frame timing
-        // --------------------
-		float currentFrame = glfwGetTime();
-		gDeltaTime = currentFrame - gLastFrame;
-		gLastFrame = currentFrame;
+		// Sleep until an event arrives when nothing needs drawing; new snapshots post an empty event
+		bool idle = gOnDemandRendering && gFramesRequested == 0;
+		if (idle)
+			glfwWaitEventsTimeout(IDLE_WAIT_TIMEOUT);
+		else
+		{
+			// Hold the frame for the limiter and the GPU queue first, so the input polled next is fresh
+			gFramePacer.WaitForFrame();
+			glfwPollEvents();
+		}
+
 		// input
 		// -----
 		UProcessInput(gWindow);
+		UApplyWindowEvents();
 
-		// Render this frame
-		URender();
+		// Pick up the newest simulation snapshot
+		if (gSnapshots.Update())
+		{
+			haveSnapshot = true;
+			URequestRedraw();
+		}
 
-		glfwPollEvents();
+		if (haveSnapshot && (!gOnDemandRendering || gFramesRequested > 0))
+		{
+			// Render this frame
+			double renderStart = glfwGetTime();
+			URender(gSnapshots.ReadBuffer());
+			if (gFrameStats)
+				UReportFrameStats((glfwGetTime() - renderStart) * 1000.0);
+
+			// Close the frame for the GL call counters / frame capture
+			UGLTrace().EndFrame();
+
+			// Let the resolution controller converge before going idle; recordings get every frame
+			if (gDynamicResolution.IsSettling() || gFrameCapture.Recording())
+				URequestRedraw(1);
+
+			if (gFramesRequested > 0)
+				--gFramesRequested;
+		}
 	}
 
+	UStopSimulation();
+
 	// Release mesh data
 	meshes.DestroyMeshes();
 
-	// Release texture
-	UDestroyTexture(gTextureId);
+	// Release textures
+	gTextureStreamer.Destroy();
+	gLightmapBaker.Destroy();
+	for (LightmapMesh& mesh : gLightmapMeshes)
+	{
+		glDeleteVertexArrays(1, &mesh.vao);
+		glDeleteBuffers(1, &mesh.vbo);
+	}
 
 	// Release shader program
 	UDestroyShaderProgram(gSurfaceProgramId);
 	UDestroyShaderProgram(gLightProgramId);
+	UDestroyShaderProgram(gDepthProgramId);
+	UDestroyShaderProgram(gBoundsProgramId);
+	UDestroyShaderProgram(gLightmappedProgramId);
+	gOcclusion.Destroy();
+	gGpuDriven.Destroy();
+	gDynamicResolution.Destroy();
+	gSamplers.Destroy();
+	glDeleteBuffers(1, &gObjectDataBuffer);
+	glDeleteBuffers(1, &gObjectIndexBuffer);
+	gStream.Destroy();
+	gFramePacer.Destroy();
+	gFrameCapture.Destroy();
+
+	// Write out whatever is still queued
+	ULogger().Stop();
 
 	exit(EXIT_SUCCESS); // Terminates the program successfully
 }
 
 
+// Reads the launch options; logs the usage and returns false on anything it does not understand
+bool UParseCommandLine(int argc, char* argv[], LaunchOptions& options)
+{
+	StressSceneOptions& stress = options.stress;
+	bool valid = true;
+	for (int i = 1; i < argc && valid; ++i)
+	{
+		std::string argument = argv[i];
+		int remaining = argc - 1 - i;
+
+		if (argument == "--stress" && remaining >= 1)
+			valid = sscanf(argv[++i], "%u", &stress.objects) == 1;
+		else if (argument == "--seed" && remaining >= 1)
+			valid = sscanf(argv[++i], "%u", &stress.seed) == 1;
+		else if (argument == "--density" && remaining >= 1)
+			valid = sscanf(argv[++i], "%f", &stress.density) == 1 && stress.density > 0.0f;
+		else if (argument == "--clustered")
+			stress.clustered = true;
+		else if (argument == "--scale" && remaining >= 2)
+		{
+			valid = sscanf(argv[i + 1], "%f", &stress.minScale) == 1 && sscanf(argv[i + 2], "%f", &stress.maxScale) == 1 &&
+				stress.minScale > 0.0f && stress.minScale <= stress.maxScale;
+			i += 2;
+		}
+		else if (argument == "--height" && remaining >= 1)
+			valid = sscanf(argv[++i], "%f", &stress.maxHeight) == 1;
+		else if (argument == "--materials" && remaining >= 1)
+			valid = sscanf(argv[++i], "%u", &stress.materials) == 1;
+		else if (argument == "--textured" && remaining >= 1)
+			valid = sscanf(argv[++i], "%f", &stress.texturedFraction) == 1;
+		else if (argument == "--multiple" && remaining >= 1)
+			valid = sscanf(argv[++i], "%f", &stress.multipleTextureFraction) == 1;
+		else if (argument == "--lights" && remaining >= 1)
+			valid = sscanf(argv[++i], "%u", &stress.lights) == 1;
+		else if (argument == "--stats")
+			options.frameStats = true;
+		else if (argument == "--latency")
+			options.lowLatency = true;
+		else if (argument == "--swap-interval" && remaining >= 1)
+			valid = options.setSwapInterval = sscanf(argv[++i], "%d", &options.swapInterval) == 1;
+		else if (argument == "--fps-limit" && remaining >= 1)
+			valid = sscanf(argv[++i], "%lf", &options.frameRateLimit) == 1 && options.frameRateLimit >= 0.0;
+		else if (argument == "--frames-in-flight" && remaining >= 1)
+			valid = sscanf(argv[++i], "%d", &options.framesInFlight) == 1 && options.framesInFlight >= 0;
+		else if (argument == "--record")
+			options.record = true;
+		else if (argument == "--record-format" && remaining >= 1)
+		{
+			std::string format = argv[++i];
+			options.recordFormat = format == "y4m" ? FrameCapture::CAPTURE_Y4M : FrameCapture::CAPTURE_PNG;
+			valid = format == "y4m" || format == "png";
+		}
+		else if (argument == "--record-fps" && remaining >= 1)
+			valid = sscanf(argv[++i], "%d", &options.recordFps) == 1 && options.recordFps > 0;
+		else if (argument.compare(0, 2, "--") != 0)
+			options.scenePath = argument;
+		else
+			valid = false;
+	}
+
+	if (!valid)
+	{
+		ULOG_ERROR("Usage: %s [scene] [--stress N [--seed S] [--density D] [--clustered] [--scale MIN MAX] [--height H] "
+			"[--materials M] [--textured F] [--multiple F] [--lights L]] [--stats] [--latency] [--swap-interval N] [--fps-limit F] "
+			"[--frames-in-flight N] [--record] [--record-format png|y4m] [--record-fps N]", argv[0]);
+		return false;
+	}
+	return true;
+}
+
+
+// Logs the average render-thread CPU time, simulation step time, GPU frame time and input latency every FRAME_STATS_INTERVAL seconds
+void UReportFrameStats(double renderMs)
+{
+	static double intervalStart = glfwGetTime();
+	static double renderMsSum = 0.0;
+	static int frames = 0;
+
+	renderMsSum += renderMs;
+	++frames;
+
+	double now = glfwGetTime();
+	if (now - intervalStart < FRAME_STATS_INTERVAL)
+		return;
+
+	ULOG_INFO("Frame cost: %.1f fps, render cpu %.2f ms, simulation %.2f ms, gpu %.2f ms at %.0f%% scale, %zu objects (%zu drawn by the CPU path)",
+		frames / (now - intervalStart), renderMsSum / frames, gSimulationStepMs.load(std::memory_order_relaxed),
+		gDynamicResolution.GpuTimeMs(), gDynamicResolution.Scale() * 100.0f, gSceneObjects.size(), gDrawOrder.size());
+
+	double latencyMs, worstLatencyMs;
+	int latencySamples;
+	if (gFramePacer.TakeLatency(latencyMs, worstLatencyMs, latencySamples))
+	{
+		ULOG_INFO("Latency: mouse to present %.2f ms average, %.2f ms worst over %d frames (late latching %s, %d frames in flight, limit %.0f fps)",
+			latencyMs, worstLatencyMs, latencySamples, gLateLatch ? "on" : "off", gFramePacer.MaxFramesInFlight, gFramePacer.FrameRateLimit);
+	}
+
+	intervalStart = now;
+	renderMsSum = 0.0;
+	frames = 0;
+}
+
+
 // Initialize GLFW, GLEW, and create a window
 bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 {
@@ -416,7 +1134,7 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 	* window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE, NULL, NULL);
 	if (*window == NULL)
 	{
-		std::cout << "Failed to create GLFW window" << std::endl;
+		ULOG_ERROR("Failed to create GLFW window");
 		glfwTerminate();
 		return false;
 	}
@@ -425,6 +1143,7 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 	glfwSetCursorPosCallback(*window, UMousePositionCallback);
 	glfwSetScrollCallback(*window, UMouseScrollCallback);
 	glfwSetMouseButtonCallback(*window, UMouseButtonCallback);
+	glfwSetWindowRefreshCallback(*window, UWindowRefreshCallback);
 
 	// tell GLFW to capture our mouse
 	glfwSetInputMode(*window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -437,12 +1156,12 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 
 	if (GLEW_OK != GlewInitResult)
 	{
-		std::cerr << glewGetErrorString(GlewInitResult) << std::endl;
+		ULOG_ERROR("%s", (const char*)glewGetErrorString(GlewInitResult));
 		return false;
 	}
 
 	// Displays GPU OpenGL version
-	cout << "INFO: OpenGL Version: " << glGetString(GL_VERSION) << endl;
+	ULOG_INFO("OpenGL Version: %s", (const char*)glGetString(GL_VERSION));
 
 	return true;
 }
@@ -452,133 +1171,458 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 void UResizeWindow(GLFWwindow* window, int width, int height)
 {
-	glViewport(0, 0, width, height);
+	gPendingWidth = width;
+	gPendingHeight = height;
+	gResizePending = true;
+	URequestRedraw();
 }
 
-// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
-void UProcessInput(GLFWwindow* window)
-{
-
-	static const float cameraSpeed = 2.5f;
-
-	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-		glfwSetWindowShouldClose(window, true);
 
-	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-		gCamera.ProcessKeyboard(FORWARD, gDeltaTime);
-	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-		gCamera.ProcessKeyboard(BACKWARD, gDeltaTime);
-	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-		gCamera.ProcessKeyboard(LEFT, gDeltaTime);
-	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-		gCamera.ProcessKeyboard(RIGHT, gDeltaTime);
-	if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
-		gCamera.ProcessKeyboard(UP, gDeltaTime);
-	if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
-		gCamera.ProcessKeyboard(DOWN, gDeltaTime);
-	if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS)
-	{
-		gOrtho = false;
-		// camera initialization
-		gCamera.Position = glm::vec3(0.0f, 5.0f, 8.0f);
-		gCamera.Front = glm::vec3(0.0f, -0.5f, -2.0f);
-		gCamera.Up = glm::vec3(0.0f, 1.0f, 0.0f);
-		}
-	if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS)
-		{
-		gOrtho = true;
-		// camera initialization
-		gCamera.Position = glm::vec3(0.0f, 0.0f, 8.0f);
-		gCamera.Front = glm::vec3(0.0f, 0.0f, -2.0f);
-		gCamera.Up = glm::vec3(0.0f, 1.0f, 0.0f);
-		}
-	if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS && gTexWrapMode != GL_REPEAT)
+// Render loop, between frames: applies the resize and pick the callbacks recorded
+void UApplyWindowEvents()
+{
+	if (gResizePending)
 	{
-		glBindTexture(GL_TEXTURE_2D, gTextureId);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glBindTexture(GL_TEXTURE_2D, 0);
-
-		gTexWrapMode = GL_REPEAT;
-
-		cout << "Current Texture Wrapping Mode: REPEAT" << endl;
+		gResizePending = false;
+		glViewport(0, 0, gPendingWidth, gPendingHeight);
+		gOcclusion.Resize(gPendingWidth, gPendingHeight);
+		gDynamicResolution.Resize(gPendingWidth, gPendingHeight);
 	}
-	else if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS && gTexWrapMode != GL_MIRRORED_REPEAT)
+
+	if (gPickPending)
 	{
-		glBindTexture(GL_TEXTURE_2D, gTextureId);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
-		glBindTexture(GL_TEXTURE_2D, 0);
+		gPickPending = false;
+		UPickObject(gWindow);
+	}
+}
 
-		gTexWrapMode = GL_MIRRORED_REPEAT;
 
-		cout << "Current Texture Wrapping Mode: MIRRORED REPEAT" << endl;
-	}
-	else if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS && gTexWrapMode != GL_CLAMP_TO_EDGE)
-	{
-		glBindTexture(GL_TEXTURE_2D, gTextureId);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		glBindTexture(GL_TEXTURE_2D, 0);
+// glfw: the window contents were damaged (exposed, restored) and must be redrawn
+void UWindowRefreshCallback(GLFWwindow* window)
+{
+	URequestRedraw();
+}
 
-		gTexWrapMode = GL_CLAMP_TO_EDGE;
 
-		cout << "Current Texture Wrapping Mode: CLAMP TO EDGE" << endl;
-	}
-	else if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS && gTexWrapMode != GL_CLAMP_TO_BORDER)
-	{
-		float color[] = { 1.0f, 0.0f, 1.0f, 1.0f };
-		glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, color);
+// Binds the cached sampler object matching a texture unit's sampling state
+void UBindUnitSampler(int unit)
+{
+	glBindSampler(unit, gSamplers.Get(gUnitSamplers[unit]));
+}
+
 
-		glBindTexture(GL_TEXTURE_2D, gTextureId);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-		glBindTexture(GL_TEXTURE_2D, 0);
+// Changes how a texture unit wraps without touching the texture bound to it
+void USetWrapMode(int unit, GLint wrapMode)
+{
+	gUnitSamplers[unit].wrapS = wrapMode;
+	gUnitSamplers[unit].wrapT = wrapMode;
+	UBindUnitSampler(unit);
 
-		gTexWrapMode = GL_CLAMP_TO_BORDER;
+	if (unit == 0)
+		gTexWrapMode = wrapMode;
+}
 
-		cout << "Current Texture Wrapping Mode: CLAMP TO BORDER" << endl;
-	}
 
-	if (glfwGetKey(window, GLFW_KEY_RIGHT_BRACKET) == GLFW_PRESS)
-	{
-		gUVScale += 0.1f;
-		cout << "Current scale (" << gUVScale[0] << ", " << gUVScale[1] << ")" << endl;
-	}
-	else if (glfwGetKey(window, GLFW_KEY_LEFT_BRACKET) == GLFW_PRESS)
+// Trilinear plus the driver's maximum anisotropy on every scene unit, or plain bilinear
+void USetAnisotropicFiltering(bool enabled)
+{
+	gAnisotropicFiltering = enabled;
+	for (int unit = 0; unit < SCENE_TEXTURE_UNITS; ++unit)
 	{
-		gUVScale -= 0.1f;
-		cout << "Current scale (" << gUVScale[0] << ", " << gUVScale[1] << ")" << endl;
+		gUnitSamplers[unit].minFilter = enabled ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR;
+		gUnitSamplers[unit].maxAnisotropy = enabled ? gSamplers.MaxAnisotropy() : 1.0f;
+		UBindUnitSampler(unit);
 	}
 }
 
 
+// Asks the render loop for at least the given number of frames; animations call it every frame they run
+void URequestRedraw(int frames)
+{
+	gFramesRequested = std::max(gFramesRequested, frames);
+}
 
 
+// Starts the simulation thread; it publishes a first snapshot right away
+void UStartSimulation()
+{
+	gInputPending = true;
+	gSimulationQuit = false;
+	gLastFrame = (float)glfwGetTime();
+	gSimulationThread = std::thread(USimulationThread);
+}
 
 
-
-// glfw: whenever the mouse moves, this callback is called
-// -------------------------------------------------------
-void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos)
+void UStopSimulation()
 {
-	if (gOrtho == true) {
-		return;
-	}
-	if (gFirstMouse)
 	{
-		gLastX = xpos;
-		gLastY = ypos;
-		gFirstMouse = false;
+		std::lock_guard<std::mutex> lock(gInputMutex);
+		gSimulationQuit = true;
 	}
+	gInputCondition.notify_one();
 
-	float xoffset = xpos - gLastX;
-	float yoffset = gLastY - ypos; // reversed since y-coordinates go from bottom to top
+	if (gSimulationThread.joinable())
+		gSimulationThread.join();
+}
 
-	gLastX = xpos;
-	gLastY = ypos;
 
-	gCamera.ProcessMouseMovement(xoffset, yoffset);
+// GLFW thread: merges input into the next simulation step and wakes the simulation thread
+void UPostSimulationInput(const SimulationInput& input)
+{
+	{
+		std::lock_guard<std::mutex> lock(gInputMutex);
+		gInput.moveKeys |= input.moveKeys;
+		if (input.viewPreset != VIEW_PRESET_NONE)
+			gInput.viewPreset = input.viewPreset;
+		gInput.mouseX += input.mouseX;
+		gInput.mouseY += input.mouseY;
+		gInput.scroll += input.scroll;
+		gInput.lookSequence = std::max(gInput.lookSequence, input.lookSequence);
+		gInputPending = true;
+	}
+	gInputCondition.notify_one();
+}
+
+
+// Simulation thread: sleeps until input arrives, steps the camera and scene, then publishes a snapshot
+void USimulationThread()
+{
+	for (;;)
+	{
+		SimulationInput input;
+		{
+			std::unique_lock<std::mutex> lock(gInputMutex);
+			gInputCondition.wait(lock, [] { return gInputPending || gSimulationQuit; });
+			if (gSimulationQuit)
+				return;
+
+			input = gInput;
+			gInput = SimulationInput();
+			gInputPending = false;
+		}
+
+		// per-step timing
+		float currentFrame = (float)glfwGetTime();
+		gDeltaTime = std::min(currentFrame - gLastFrame, MAX_STEP_DELTA);
+		gLastFrame = currentFrame;
+
+		USimulationStep(input);
+		UPublishSnapshot();
+		gSimulationStepMs.store((float)((glfwGetTime() - currentFrame) * 1000.0), std::memory_order_relaxed);
+
+		// Wake the render loop if it is waiting for events
+		glfwPostEmptyEvent();
+	}
+}
+
+
+// Simulation thread: applies one step of input to the camera
+void USimulationStep(const SimulationInput& input)
+{
+	if (input.viewPreset == VIEW_PRESET_PERSPECTIVE)
+	{
+		gOrtho = false;
+		// camera initialization
+		gCamera.Position = glm::vec3(0.0f, 5.0f, 8.0f);
+		gCamera.Front = glm::vec3(0.0f, -0.5f, -2.0f);
+		gCamera.Up = glm::vec3(0.0f, 1.0f, 0.0f);
+	}
+	else if (input.viewPreset == VIEW_PRESET_ORTHO)
+	{
+		gOrtho = true;
+		// camera initialization
+		gCamera.Position = glm::vec3(0.0f, 0.0f, 8.0f);
+		gCamera.Front = glm::vec3(0.0f, 0.0f, -2.0f);
+		gCamera.Up = glm::vec3(0.0f, 1.0f, 0.0f);
+	}
+
+	static const Camera_Movement directions[] = { FORWARD, BACKWARD, LEFT, RIGHT, UP, DOWN };
+	for (Camera_Movement direction : directions)
+	{
+		if (input.moveKeys & (1u << direction))
+			gCamera.ProcessKeyboard(direction, gDeltaTime);
+	}
+
+	// Mouse look is disabled in the orthographic view
+	if (!gOrtho && (input.mouseX != 0.0f || input.mouseY != 0.0f))
+		gCamera.ProcessMouseMovement(input.mouseX, input.mouseY);
+	if (input.scroll != 0.0f)
+		gCamera.ProcessMouseScroll(input.scroll);
+	gConsumedLook = std::max(gConsumedLook, input.lookSequence);
+}
+
+
+// Simulation thread: fills the free snapshot slot with the camera, scene and draw list and publishes it
+void UPublishSnapshot()
+{
+	FrameSnapshot& frame = gSnapshots.WriteBuffer();
+	frame.frame = ++gSimulationFrame;
+
+	// camera/view transformation
+	frame.view = gCamera.GetViewMatrix();
+
+	// Creates a perspective projection
+	if (gOrtho == false) {
+		frame.projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+	}
+	else {
+		frame.projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, 0.1f, 100.0f);
+	}
+	frame.viewProjection = frame.projection * frame.view;
+	frame.camera = gCamera;
+	frame.ortho = gOrtho;
+	frame.lookSequence = gConsumedLook;
+
+	// Slots are recycled; only copy the scene into one that holds an older version
+	if (frame.sceneVersion != gSceneVersion)
+	{
+		frame.objects = gSimulationScene;
+		frame.sceneVersion = gSceneVersion;
+	}
+
+	// Only the CPU path draws from the sorted list; the GPU-driven path culls on the GPU
+	frame.hasDrawOrder = !gGpuDrivenRendering.load(std::memory_order_relaxed);
+	if (frame.hasDrawOrder)
+		UBuildDrawOrder(frame);
+	else
+		frame.drawOrder.clear();
+	gSnapshots.Publish();
+}
+
+// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
+void UProcessInput(GLFWwindow* window)
+{
+
+	static const float cameraSpeed = 2.5f;
+
+	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+		glfwSetWindowShouldClose(window, true);
+
+	// Camera input is applied by the simulation thread
+	SimulationInput input;
+	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+		input.moveKeys |= 1u << FORWARD;
+	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+		input.moveKeys |= 1u << BACKWARD;
+	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+		input.moveKeys |= 1u << LEFT;
+	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+		input.moveKeys |= 1u << RIGHT;
+	if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
+		input.moveKeys |= 1u << UP;
+	if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
+		input.moveKeys |= 1u << DOWN;
+	if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS)
+		input.viewPreset = VIEW_PRESET_PERSPECTIVE;
+	if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS)
+		input.viewPreset = VIEW_PRESET_ORTHO;
+	if (input.moveKeys != 0 || input.viewPreset != VIEW_PRESET_NONE)
+	{
+		UPostSimulationInput(input);
+
+		// Keep the loop polling while a key is held
+		URequestRedraw();
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS && gTexWrapMode != GL_REPEAT)
+	{
+		USetWrapMode(0, GL_REPEAT);
+		URequestRedraw();
+
+		ULOG_INFO("Current Texture Wrapping Mode: REPEAT");
+	}
+	else if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS && gTexWrapMode != GL_MIRRORED_REPEAT)
+	{
+		USetWrapMode(0, GL_MIRRORED_REPEAT);
+		URequestRedraw();
+
+		ULOG_INFO("Current Texture Wrapping Mode: MIRRORED REPEAT");
+	}
+	else if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS && gTexWrapMode != GL_CLAMP_TO_EDGE)
+	{
+		USetWrapMode(0, GL_CLAMP_TO_EDGE);
+		URequestRedraw();
+
+		ULOG_INFO("Current Texture Wrapping Mode: CLAMP TO EDGE");
+	}
+	else if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS && gTexWrapMode != GL_CLAMP_TO_BORDER)
+	{
+		USetWrapMode(0, GL_CLAMP_TO_BORDER);
+		URequestRedraw();
+
+		ULOG_INFO("Current Texture Wrapping Mode: CLAMP TO BORDER");
+	}
+
+	// F1 toggles the depth pre-pass
+	static bool prepassKeyDown = false;
+	bool prepassKey = glfwGetKey(window, GLFW_KEY_F1) == GLFW_PRESS;
+	if (prepassKey && !prepassKeyDown)
+	{
+		gDepthPrepass = !gDepthPrepass;
+		URequestRedraw();
+		ULOG_INFO("Depth pre-pass: %s", gDepthPrepass ? "ON" : "OFF");
+	}
+	prepassKeyDown = prepassKey;
+
+	// F2 toggles occlusion culling
+	static bool occlusionKeyDown = false;
+	bool occlusionKey = glfwGetKey(window, GLFW_KEY_F2) == GLFW_PRESS;
+	if (occlusionKey && !occlusionKeyDown)
+	{
+		gOcclusionCulling = !gOcclusionCulling;
+		URequestRedraw();
+		ULOG_INFO("Occlusion culling: %s", gOcclusionCulling ? "ON" : "OFF");
+	}
+	occlusionKeyDown = occlusionKey;
+
+	// F3 toggles GPU-driven rendering
+	static bool gpuDrivenKeyDown = false;
+	bool gpuDrivenKey = glfwGetKey(window, GLFW_KEY_F3) == GLFW_PRESS;
+	if (gpuDrivenKey && !gpuDrivenKeyDown)
+	{
+		gGpuDrivenRendering = !gGpuDrivenRendering;
+		URequestRedraw();
+
+		// Have the simulation publish a snapshot with (or without) a draw list right away
+		UPostSimulationInput(SimulationInput());
+		ULOG_INFO("GPU-driven rendering: %s", gGpuDrivenRendering ? "ON" : "OFF");
+	}
+	gpuDrivenKeyDown = gpuDrivenKey;
+
+	// F4 toggles on-demand rendering
+	static bool onDemandKeyDown = false;
+	bool onDemandKey = glfwGetKey(window, GLFW_KEY_F4) == GLFW_PRESS;
+	if (onDemandKey && !onDemandKeyDown)
+	{
+		gOnDemandRendering = !gOnDemandRendering;
+		URequestRedraw();
+		ULOG_INFO("On-demand rendering: %s", gOnDemandRendering ? "ON" : "OFF");
+	}
+	onDemandKeyDown = onDemandKey;
+
+	// F5 toggles dynamic resolution scaling
+	static bool dynamicResolutionKeyDown = false;
+	bool dynamicResolutionKey = glfwGetKey(window, GLFW_KEY_F5) == GLFW_PRESS;
+	if (dynamicResolutionKey && !dynamicResolutionKeyDown)
+	{
+		gDynamicResolution.SetEnabled(!gDynamicResolution.IsEnabled());
+		URequestRedraw();
+		ULOG_INFO("Dynamic resolution: %s", gDynamicResolution.IsEnabled() ? "ON" : "OFF");
+	}
+	dynamicResolutionKeyDown = dynamicResolutionKey;
+
+	// F6 toggles anisotropic filtering
+	static bool anisotropyKeyDown = false;
+	bool anisotropyKey = glfwGetKey(window, GLFW_KEY_F6) == GLFW_PRESS;
+	if (anisotropyKey && !anisotropyKeyDown)
+	{
+		USetAnisotropicFiltering(!gAnisotropicFiltering);
+		URequestRedraw();
+		ULOG_INFO("Anisotropic filtering: %s (max %gx)", gAnisotropicFiltering ? "ON" : "OFF", gSamplers.MaxAnisotropy());
+	}
+	anisotropyKeyDown = anisotropyKey;
+
+	// F7 cycles the texture memory budget
+	static bool textureBudgetKeyDown = false;
+	bool textureBudgetKey = glfwGetKey(window, GLFW_KEY_F7) == GLFW_PRESS;
+	if (textureBudgetKey && !textureBudgetKeyDown)
+	{
+		gTextureBudget = (gTextureBudget + 1) % (int)(sizeof(TEXTURE_BUDGETS) / sizeof(TEXTURE_BUDGETS[0]));
+		gTextureStreamer.BudgetBytes = TEXTURE_BUDGETS[gTextureBudget];
+		URequestRedraw();
+		gTextureStreamer.LogResidency();
+	}
+	textureBudgetKeyDown = textureBudgetKey;
+
+	// F8 toggles baked lighting for static objects
+	static bool bakedLightingKeyDown = false;
+	bool bakedLightingKey = glfwGetKey(window, GLFW_KEY_F8) == GLFW_PRESS;
+	if (bakedLightingKey && !bakedLightingKeyDown)
+	{
+		gBakedLighting = !gBakedLighting;
+		if (!gSceneObjects.empty())
+			UBuildGpuDraws();
+		URequestRedraw();
+		ULOG_INFO("Baked lighting: %s", gBakedLighting ? "ON" : "OFF");
+	}
+	bakedLightingKeyDown = bakedLightingKey;
+
+	// F9 toggles late latching of the mouse look
+	static bool lateLatchKeyDown = false;
+	bool lateLatchKey = glfwGetKey(window, GLFW_KEY_F9) == GLFW_PRESS;
+	if (lateLatchKey && !lateLatchKeyDown)
+	{
+		gLateLatch = !gLateLatch;
+		ULOG_INFO("Late latching: %s", gLateLatch ? "ON" : "OFF");
+	}
+	lateLatchKeyDown = lateLatchKey;
+
+	// F10 starts and stops recording
+	static bool recordKeyDown = false;
+	bool recordKey = glfwGetKey(window, GLFW_KEY_F10) == GLFW_PRESS;
+	if (recordKey && !recordKeyDown)
+		UToggleRecording();
+	recordKeyDown = recordKey;
+
+	// GL trace: F11 prints the last frame's call counters, F12 captures the next frame to a file
+	static bool traceStatsKeyDown = false;
+	static bool traceCaptureKeyDown = false;
+	bool statsKey = glfwGetKey(window, GLFW_KEY_F11) == GLFW_PRESS;
+	bool captureKey = glfwGetKey(window, GLFW_KEY_F12) == GLFW_PRESS;
+	if (statsKey && !traceStatsKeyDown)
+		UGLTrace().PrintLastFrame();
+	if (captureKey && !traceCaptureKeyDown)
+	{
+		UGLTrace().RequestCapture("gl_frame_capture.txt");
+		URequestRedraw(1);
+	}
+	traceStatsKeyDown = statsKey;
+	traceCaptureKeyDown = captureKey;
+
+	if (glfwGetKey(window, GLFW_KEY_RIGHT_BRACKET) == GLFW_PRESS)
+	{
+		gUVScale += 0.1f;
+		URequestRedraw();
+		ULOG_INFO_EVERY(0.25, "Current scale (%g, %g)", gUVScale[0], gUVScale[1]);
+	}
+	else if (glfwGetKey(window, GLFW_KEY_LEFT_BRACKET) == GLFW_PRESS)
+	{
+		gUVScale -= 0.1f;
+		URequestRedraw();
+		ULOG_INFO_EVERY(0.25, "Current scale (%g, %g)", gUVScale[0], gUVScale[1]);
+	}
+}
+
+
+
+
+
+
+
+// glfw: whenever the mouse moves, this callback is called
+// -------------------------------------------------------
+void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos)
+{
+	if (gFirstMouse)
+	{
+		gLastX = xpos;
+		gLastY = ypos;
+		gFirstMouse = false;
+	}
+
+	float xoffset = xpos - gLastX;
+	float yoffset = gLastY - ypos; // reversed since y-coordinates go from bottom to top
+
+	gLastX = xpos;
+	gLastY = ypos;
+
+	// Numbered and kept for late latching until a snapshot contains it
+	SimulationInput input;
+	input.mouseX = xoffset;
+	input.mouseY = yoffset;
+	input.lookSequence = ++gLookSequence;
+	gPendingLook.push_back({ input.lookSequence, xoffset, yoffset, FramePacer::Now() });
+	UPostSimulationInput(input);
 }
 
 
@@ -586,401 +1630,1116 @@ void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos)
 // ----------------------------------------------------------------------
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 {
-	gCamera.ProcessMouseScroll(yoffset);
+	SimulationInput input;
+	input.scroll = yoffset;
+	UPostSimulationInput(input);
+}
+
+// glfw: handle mouse button events
+// --------------------------------
+void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
+{
+	switch (button)
+	{
+	case GLFW_MOUSE_BUTTON_LEFT:
+	{
+		if (action == GLFW_PRESS)
+		{
+			ULOG_DEBUG("Left mouse button pressed");
+			gPickPending = true;
+		}
+		else
+			ULOG_DEBUG("Left mouse button released");
+	}
+	break;
+
+	case GLFW_MOUSE_BUTTON_MIDDLE:
+	{
+		if (action == GLFW_PRESS)
+			ULOG_DEBUG("Middle mouse button pressed");
+		else
+			ULOG_DEBUG("Middle mouse button released");
+	}
+	break;
+
+	case GLFW_MOUSE_BUTTON_RIGHT:
+	{
+		if (action == GLFW_PRESS)
+			ULOG_DEBUG("Right mouse button pressed");
+		else
+			ULOG_DEBUG("Right mouse button released");
+	}
+	break;
+
+	default:
+		ULOG_DEBUG("Unhandled mouse button event");
+		break;
+	}
+}
+
+
+// Reads a whole buffer back to the CPU
+std::vector<unsigned char> UReadBuffer(GLuint buffer)
+{
+	GLint size = 0;
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+	std::vector<unsigned char> data((size_t)std::max(size, 0));
+	if (size > 0)
+		glGetBufferSubData(GL_COPY_READ_BUFFER, 0, size, data.data());
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	return data;
+}
+
+
+// Expands every draw of a mesh into a triangle list, reading positions and, when asked for, normals
+// (attribute 1) and texture coordinates (attribute 2) back from the buffers behind its VAO
+bool UReadMeshTriangles(MeshKind mesh, std::vector<glm::vec3>& positions, std::vector<glm::vec3>* normals, std::vector<glm::vec2>* uvs)
+{
+	// Layout of one float attribute and a copy of the buffer it reads from
+	struct Attribute
+	{
+		std::vector<unsigned char> data;
+		size_t offset = 0;
+		size_t stride = 0;
+		size_t count = 0;			// vertices the buffer holds
+		GLint components = 0;
+	};
+	auto readAttribute = [](GLuint index, Attribute& attribute, GLint minComponents)
+		{
+			GLint enabled = 0, buffer = 0, stride = 0, components = 0, type = 0;
+			void* offset = nullptr;
+			glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &enabled);
+			glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &buffer);
+			glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &stride);
+			glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_SIZE, &components);
+			glGetVertexAttribiv(index, GL_VERTEX_ATTRIB_ARRAY_TYPE, &type);
+			glGetVertexAttribPointerv(index, GL_VERTEX_ATTRIB_ARRAY_POINTER, &offset);
+			if (!enabled || !buffer || components < minComponents || type != GL_FLOAT)
+				return false;
+
+			attribute.data = UReadBuffer(buffer);
+			attribute.offset = (size_t)offset;
+			attribute.stride = stride ? stride : components * sizeof(GLfloat);
+			attribute.components = minComponents;
+			size_t size = minComponents * sizeof(GLfloat);
+			attribute.count = attribute.data.size() >= attribute.offset + size ? (attribute.data.size() - attribute.offset - size) / attribute.stride + 1 : 0;
+			return true;
+		};
+
+	glBindVertexArray(UMeshVao(mesh));
+	Attribute position, normal, uv;
+	bool valid = readAttribute(0, position, 3) &&
+		(!normals || readAttribute(1, normal, 3)) &&
+		(!uvs || readAttribute(2, uv, 2));
+	GLint indexBuffer = 0;
+	glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &indexBuffer);
+	glBindVertexArray(0);
+	if (!valid)
+		return false;
+
+	std::vector<unsigned char> indexData = indexBuffer ? UReadBuffer(indexBuffer) : std::vector<unsigned char>();
+	size_t vertexCount = std::min(position.count, std::min(normals ? normal.count : position.count, uvs ? uv.count : position.count));
+	size_t indexCount = indexData.size() / sizeof(GLuint);
+	const GLuint* indices = (const GLuint*)indexData.data();
+
+	positions.clear();
+	if (normals)
+		normals->clear();
+	if (uvs)
+		uvs->clear();
+
+	MeshDraw draws[MAX_MESH_DRAWS];
+	int drawCount = UMeshDraws(mesh, draws);
+	for (int d = 0; d < drawCount; ++d)
+	{
+		const MeshDraw& draw = draws[d];
+		GLuint steps = draw.mode == GL_TRIANGLES ? draw.count / 3 : (draw.count >= 3 ? draw.count - 2 : 0);
+		for (GLuint step = 0; step < steps; ++step)
+		{
+			GLuint corners[3];
+			if (draw.mode == GL_TRIANGLES)
+				corners[0] = 3 * step, corners[1] = 3 * step + 1, corners[2] = 3 * step + 2;
+			else if (draw.mode == GL_TRIANGLE_FAN)
+				corners[0] = 0, corners[1] = step + 1, corners[2] = step + 2;
+			else if (step % 2 == 0)
+				corners[0] = step, corners[1] = step + 1, corners[2] = step + 2;
+			else
+				corners[0] = step + 1, corners[1] = step, corners[2] = step + 2;		// strips alternate winding
+
+			size_t vertices[3];
+			bool inside = true;
+			for (int c = 0; c < 3 && inside; ++c)
+			{
+				size_t element = draw.first + corners[c];
+				vertices[c] = draw.indexed ? (element < indexCount ? indices[element] : vertexCount) : element;
+				inside = vertices[c] < vertexCount;
+			}
+			if (!inside)
+				continue;
+
+			for (int c = 0; c < 3; ++c)
+			{
+				GLfloat value[3];
+				std::memcpy(value, &position.data[position.offset + vertices[c] * position.stride], 3 * sizeof(GLfloat));
+				positions.push_back(glm::vec3(value[0], value[1], value[2]));
+				if (normals)
+				{
+					std::memcpy(value, &normal.data[normal.offset + vertices[c] * normal.stride], 3 * sizeof(GLfloat));
+					normals->push_back(glm::vec3(value[0], value[1], value[2]));
+				}
+				if (uvs)
+				{
+					std::memcpy(value, &uv.data[uv.offset + vertices[c] * uv.stride], 2 * sizeof(GLfloat));
+					uvs->push_back(glm::vec2(value[0], value[1]));
+				}
+			}
+		}
+	}
+	return true;
+}
+
+
+// Builds each mesh's triangle BVH from the positions and indices its VAO draws; runs once at startup
+void UBuildPickMeshes()
+{
+	size_t triangleCount = 0;
+	std::vector<glm::vec3> triangles;
+	for (int kind = 0; kind < MESH_KIND_COUNT; ++kind)
+	{
+		if (!UReadMeshTriangles((MeshKind)kind, triangles, nullptr, nullptr))
+		{
+			ULOG_WARNING("Mesh %s has no float positions and cannot be picked", MESH_NAMES[kind]);
+			continue;
+		}
+
+		gPickMeshes[kind].Build(triangles);
+		triangleCount += gPickMeshes[kind].TriangleCount();
+	}
+
+	ULOG_DEBUG("Picking: %zu mesh triangles", triangleCount);
+}
+
+
+// Unrolls each mesh into a triangle list carrying a lightmap chart as a second UV set (attribute 4),
+// for the static objects drawn with baked lighting; runs once at startup
+void UBuildLightmapMeshes()
+{
+	std::vector<glm::vec3> positions, normals;
+	std::vector<glm::vec2> uvs;
+	for (int kind = 0; kind < MESH_KIND_COUNT; ++kind)
+	{
+		if (!UReadMeshTriangles((MeshKind)kind, positions, &normals, &uvs) || positions.empty())
+		{
+			ULOG_WARNING("Mesh %s has no float positions, normals and texture coordinates and cannot be lightmapped", MESH_NAMES[kind]);
+			continue;
+		}
+
+		std::vector<LightmapVertex> vertices(positions.size());
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			vertices[i].position = positions[i];
+			vertices[i].normal = normals[i];
+			vertices[i].uv = uvs[i];
+		}
+		int grid = gLightmapBaker.BuildChart(vertices);
+		gLightmapBaker.SetChart(kind, vertices, grid);
+
+		LightmapMesh& mesh = gLightmapMeshes[kind];
+		mesh.vertexCount = (GLuint)vertices.size();
+		glGenVertexArrays(1, &mesh.vao);
+		glGenBuffers(1, &mesh.vbo);
+		glBindVertexArray(mesh.vao);
+		glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(LightmapVertex), vertices.data(), GL_STATIC_DRAW);
+
+		const GLsizei stride = sizeof(LightmapVertex);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(LightmapVertex, position));
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(LightmapVertex, normal));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(LightmapVertex, uv));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(LightmapVertex, lightmapUv));
+		glEnableVertexAttribArray(4);
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+
+// Casts a ray through the cursor with the displayed frame's camera and selects the closest object it hits
+void UPickObject(GLFWwindow* window)
+{
+	// Nothing rendered yet
+	if (gSceneObjects.empty())
+		return;
+
+	int width = 0, height = 0;
+	glfwGetWindowSize(window, &width, &height);
+	if (width <= 0 || height <= 0)
+		return;
+
+	double x = 0.5 * width, y = 0.5 * height;
+	if (glfwGetInputMode(window, GLFW_CURSOR) != GLFW_CURSOR_DISABLED)
+		glfwGetCursorPos(window, &x, &y);
+
+	// Unproject the cursor at the near and far planes
+	const FrameSnapshot& frame = gSnapshots.ReadBuffer();
+	glm::mat4 inverseViewProjection = glm::inverse(frame.viewProjection);
+	float ndcX = (float)(2.0 * x / width - 1.0);
+	float ndcY = (float)(1.0 - 2.0 * y / height);
+	glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+	glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+	glm::vec3 origin = glm::vec3(nearPoint / nearPoint.w);
+	glm::vec3 direction = glm::vec3(farPoint / farPoint.w) - origin;
+
+	double start = glfwGetTime();
+	ScenePicker::Hit hit = gPicker.Pick(origin, direction, [](uint32_t index, glm::mat4& model, const PickMesh*& mesh)
+		{
+			const SceneObject& object = gSceneObjects[index];
+			model = object.model;
+			mesh = &gPickMeshes[object.mesh];
+		});
+	double pickMs = (glfwGetTime() - start) * 1000.0;
+
+	if (hit.object != gSelectedObject)
+	{
+		USetObjectSelected(gSelectedObject, false);
+		USetObjectSelected(hit.object, true);
+		gSelectedObject = hit.object;
+		URequestRedraw();
+	}
+
+	if (hit.object >= 0)
+		ULOG_INFO("Picked object %d (%s) at distance %.2f in %.3f ms", hit.object, MESH_NAMES[gSceneObjects[hit.object].mesh], hit.distance, pickMs);
+	else
+		ULOG_INFO("Picked nothing (%.3f ms)", pickMs);
+}
+
+
+// Sets or clears the selected flag (flags.z) of one object in the object buffer
+void USetObjectSelected(int index, bool selected)
+{
+	if (index < 0 || index >= (int)gSceneObjects.size())
+		return;
+
+	GLint flag = selected ? 1 : 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, gObjectDataBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, index * sizeof(ObjectData) + offsetof(ObjectData, flags) + 2 * sizeof(GLint), sizeof(flag), &flag);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+
+// Local-space bounds of the Meshes primitives
+void UMeshLocalBounds(MeshKind mesh, glm::vec3& boundsMin, glm::vec3& boundsMax)
+{
+	switch (mesh)
+	{
+	case MESH_PLANE:
+		boundsMin = glm::vec3(-1.0f, 0.0f, -1.0f);
+		boundsMax = glm::vec3(1.0f, 0.0f, 1.0f);
+		break;
+	case MESH_SPHERE:
+		boundsMin = glm::vec3(-1.0f);
+		boundsMax = glm::vec3(1.0f);
+		break;
+	case MESH_CYLINDER:
+		boundsMin = glm::vec3(-1.0f, 0.0f, -1.0f);
+		boundsMax = glm::vec3(1.0f, 1.0f, 1.0f);
+		break;
+	default: // box and pyramid
+		boundsMin = glm::vec3(-0.5f);
+		boundsMax = glm::vec3(0.5f);
+		break;
+	}
+}
+
+
+// Names and local bounds of the meshes scene files may use
+void USceneMeshInfo(SceneMeshInfo meshInfo[MESH_KIND_COUNT])
+{
+	for (int mesh = 0; mesh < MESH_KIND_COUNT; ++mesh)
+	{
+		meshInfo[mesh].name = MESH_NAMES[mesh];
+		UMeshLocalBounds((MeshKind)mesh, meshInfo[mesh].boundsMin, meshInfo[mesh].boundsMax);
+	}
+}
+
+
+// Compiles a text scene if needed and maps the binary form
+bool UOpenScene(const std::string& path, SceneFile& scene)
+{
+	SceneMeshInfo meshInfo[MESH_KIND_COUNT];
+	USceneMeshInfo(meshInfo);
+
+	if (!UCompileSceneIfStale(path, meshInfo, MESH_KIND_COUNT))
+		return false;
+	return scene.Open(USceneBinaryPath(path).c_str());
+}
+
+
+// Generates a stress scene with the textures of the given scene, writes it to STRESS_SCENE_PATH and maps it
+bool UOpenStressScene(const LaunchOptions& options, SceneFile& scene)
+{
+	if (!UOpenScene(options.scenePath, scene))
+		return false;
+	std::vector<SceneFileTexture> textures(scene.Textures(), scene.Textures() + scene.Header().textureCount);
+	scene.Close();
+
+	SceneMeshInfo meshInfo[MESH_KIND_COUNT];
+	USceneMeshInfo(meshInfo);
+
+	double start = glfwGetTime();
+	if (!UGenerateStressScene(options.stress, textures, meshInfo, MESH_KIND_COUNT, MESH_NAMES[MESH_PLANE], MESH_NAMES[MESH_PYRAMID4], STRESS_SCENE_PATH))
+		return false;
+	ULOG_INFO("Generated stress scene %s: %u objects, seed %u (%.1f ms)", STRESS_SCENE_PATH, options.stress.objects, options.stress.seed, (glfwGetTime() - start) * 1000.0);
+
+	return scene.Open(STRESS_SCENE_PATH);
+}
+
+
+// Builds the draw list from a mapped scene file (before the simulation thread starts, or on it)
+bool UCreateScene(const SceneFile& scene)
+{
+	const SceneFileHeader& header = scene.Header();
+
+	std::vector<SurfaceMaterial> materials(header.materialCount);
+	for (uint32_t i = 0; i < header.materialCount; ++i)
+	{
+		const SceneFileMaterial& source = scene.Materials()[i];
+		if (source.textureUnit >= SCENE_TEXTURE_UNITS)
+		{
+			ULOG_ERROR("Scene material %u uses texture unit %d", i, source.textureUnit);
+			return false;
+		}
+
+		SurfaceMaterial& material = materials[i];
+		material.textureUnit = std::max(source.textureUnit, 0);
+		material.hasTexture = (source.flags & SCENE_MATERIAL_HAS_TEXTURE) != 0;
+		material.multipleTextures = (source.flags & SCENE_MATERIAL_MULTIPLE_TEXTURES) != 0;
+		material.objectColor = glm::make_vec4(source.objectColor);
+		material.ambientStrength = source.ambientStrength;
+		material.ambientColor = glm::make_vec3(source.ambientColor);
+		material.light1Color = glm::make_vec3(source.light1Color);
+		material.light1Position = glm::make_vec3(source.light1Position);
+		material.light2Color = glm::make_vec3(source.light2Color);
+		material.light2Position = glm::make_vec3(source.light2Position);
+		material.specularIntensity1 = source.specular[0];
+		material.highlightSize1 = source.specular[1];
+		material.specularIntensity2 = source.specular[2];
+		material.highlightSize2 = source.specular[3];
+	}
+
+	// One allocation for the whole scene; transforms and bounds are copied out of the mapping as written
+	gSimulationScene.resize(header.objectCount);
+	const SceneFileObject* records = scene.Objects();
+	for (uint32_t i = 0; i < header.objectCount; ++i)
+	{
+		const SceneFileObject& record = records[i];
+		if (record.mesh >= MESH_KIND_COUNT)
+		{
+			ULOG_ERROR("Scene object %u uses unknown mesh %u", i, record.mesh);
+			gSimulationScene.clear();
+			return false;
+		}
+
+		SceneObject& object = gSimulationScene[i];
+		object.mesh = (MeshKind)record.mesh;
+		object.model = glm::make_mat4(record.model);
+		object.isLight = (record.flags & SCENE_OBJECT_LIGHT) != 0;
+		object.isStatic = (record.flags & SCENE_OBJECT_STATIC) != 0;
+		object.material = materials[record.material];
+		object.center = glm::make_vec3(record.center);
+		object.boundsMin = glm::make_vec3(record.boundsMin);
+		object.boundsMax = glm::make_vec3(record.boundsMax);
+	}
+
+	// Snapshots carry the new scene to the render thread
+	++gSceneVersion;
+	return true;
+}
+
+
+// Packs the scene into the object data SSBO and hands bounds and draws to the culling stages;
+// call whenever objects are added, removed or changed
+void UUploadScene()
+{
+	GLuint objectCount = (GLuint)gSceneObjects.size();
+
+	// Static objects' lightmaps are baked (or read from the cache) before their object data is written
+	std::vector<glm::vec4> lightmapScaleOffsets;
+	UBakeLightmaps(lightmapScaleOffsets);
+
+	std::vector<ObjectData> objectData(objectCount);
+	std::vector<GLuint> objectIndices(objectCount);
+	std::vector<glm::vec3> boundsMin(objectCount);
+	std::vector<glm::vec3> boundsMax(objectCount);
+	for (GLuint i = 0; i < objectCount; ++i)
+	{
+		const SceneObject& object = gSceneObjects[i];
+		const SurfaceMaterial& material = object.material;
+		ObjectData& data = objectData[i];
+
+		data.model = object.model;
+		data.objectColor = material.objectColor;
+		data.ambient = glm::vec4(material.ambientColor, material.ambientStrength);
+		data.light1Color = glm::vec4(material.light1Color, 1.0f);
+		data.light1Position = glm::vec4(material.light1Position, 1.0f);
+		data.light2Color = glm::vec4(material.light2Color, 1.0f);
+		data.light2Position = glm::vec4(material.light2Position, 1.0f);
+		data.specular = glm::vec4(material.specularIntensity1, material.highlightSize1, material.specularIntensity2, material.highlightSize2);
+		data.flags[0] = material.hasTexture;
+		data.flags[1] = material.multipleTextures;
+		data.flags[2] = 0;
+		data.flags[3] = 0;
+		data.lightmapScaleOffset = lightmapScaleOffsets[i];
+
+		objectIndices[i] = i;
+		boundsMin[i] = object.boundsMin;
+		boundsMax[i] = object.boundsMax;
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, gObjectDataBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, (objectCount ? objectCount : 1) * sizeof(ObjectData), objectCount ? objectData.data() : NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, gObjectDataBuffer);
+
+	// Attribute 3 of every mesh VAO reads the object index once per instance, so base instance N yields N
+	glBindBuffer(GL_ARRAY_BUFFER, gObjectIndexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, (objectCount ? objectCount : 1) * sizeof(GLuint), objectCount ? objectIndices.data() : NULL, GL_STATIC_DRAW);
+	for (int vao = 0; vao < 2 * MESH_KIND_COUNT; ++vao)
+	{
+		GLuint meshVao = UMeshVao((MeshKind)(vao % MESH_KIND_COUNT), vao >= MESH_KIND_COUNT);
+		if (!meshVao)
+			continue;
+		glBindVertexArray(meshVao);
+		glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+		glVertexAttribDivisor(3, 1);
+		glEnableVertexAttribArray(3);
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	gOcclusion.SetObjectBounds(boundsMin, boundsMax);
+	gPicker.SetObjectBounds(boundsMin, boundsMax);
+	gSelectedObject = -1;
+	gUseOcclusionQuery.assign(objectCount, 0);
+	gQueryBoxSlot.assign(objectCount, 0);
+
+	UBuildGpuDraws();
+	URequestRedraw();
+}
+
+
+// Bakes the lightmap atlas of the scene's static objects, or loads it from the cache when nothing
+// it depends on changed, and uploads it; scaleOffsets receives every object's atlas region
+void UBakeLightmaps(std::vector<glm::vec4>& scaleOffsets)
+{
+	scaleOffsets.assign(gSceneObjects.size(), glm::vec4(0.0f));
+	gHasLightmap.assign(gSceneObjects.size(), 0);
+
+	std::vector<LightmapObject> objects;
+	std::vector<size_t> objectIndices;
+	for (size_t i = 0; i < gSceneObjects.size(); ++i)
+	{
+		const SceneObject& object = gSceneObjects[i];
+		if (!object.isStatic || object.isLight || !gLightmapMeshes[object.mesh].vao)
+			continue;
+
+		LightmapObject lightmapObject;
+		lightmapObject.chart = object.mesh;
+		lightmapObject.model = object.model;
+		lightmapObject.light1Color = object.material.light1Color;
+		lightmapObject.light1Position = object.material.light1Position;
+		lightmapObject.light2Color = object.material.light2Color;
+		lightmapObject.light2Position = object.material.light2Position;
+		objects.push_back(lightmapObject);
+		objectIndices.push_back(i);
+	}
+
+	// Without an atlas every object keeps the full Phong shader
+	if (!gLightmapBaker.Bake(objects, gLightmapCachePath))
+	{
+		gLightmapBaker.Destroy();
+		return;
+	}
+	gLightmapBaker.Upload(LIGHTMAP_TEXTURE_UNIT);
+
+	const std::vector<glm::vec4>& regions = gLightmapBaker.Regions();
+	for (size_t i = 0; i < objectIndices.size(); ++i)
+	{
+		scaleOffsets[objectIndices[i]] = regions[i];
+		gHasLightmap[objectIndices[i]] = 1;
+	}
 }
 
-// glfw: handle mouse button events
-// --------------------------------
-void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
+
+// Whether an object is drawn with the baked lighting variant
+bool UIsLightmapped(size_t objectIndex)
 {
-	switch (button)
+	return gBakedLighting && gHasLightmap[objectIndex];
+}
+
+
+// Groups every mesh draw of the scene into indirect batches for the GPU-driven path
+void UBuildGpuDraws()
+{
+	std::vector<GpuDrawBatch> batches;
+	std::vector<GpuDrawRecord> records;
+
+	for (size_t i = 0; i < gSceneObjects.size(); ++i)
 	{
-	case GLFW_MOUSE_BUTTON_LEFT:
+		const SceneObject& object = gSceneObjects[i];
+		bool lightmapped = UIsLightmapped(i);
+		GLuint vao = UMeshVao(object.mesh, lightmapped);
+		GLint textureUnit = object.isLight ? -1 : object.material.textureUnit;
+
+		MeshDraw draws[MAX_MESH_DRAWS];
+		int drawCount = UMeshDraws(object.mesh, draws, lightmapped);
+		for (int d = 0; d < drawCount; ++d)
+		{
+			// One batch per VAO, primitive mode, shader and texture unit
+			size_t b = 0;
+			while (b < batches.size() && !(batches[b].vao == vao && batches[b].mode == draws[d].mode &&
+				batches[b].indexed == draws[d].indexed && batches[b].isLight == object.isLight &&
+				batches[b].lightmapped == lightmapped && batches[b].textureUnit == textureUnit))
+				++b;
+			if (b == batches.size())
+			{
+				GpuDrawBatch batch;
+				batch.vao = vao;
+				batch.mode = draws[d].mode;
+				batch.indexed = draws[d].indexed;
+				batch.isLight = object.isLight;
+				batch.lightmapped = lightmapped;
+				batch.textureUnit = textureUnit;
+				batch.commandOffset = 0;
+				batch.maxCount = 0;
+				batches.push_back(batch);
+			}
+
+			GpuDrawRecord record;
+			record.objectIndex = (GLuint)i;
+			record.batch = (GLuint)b;
+			record.commandOffset = 0;
+			record.commandSlot = batches[b].maxCount++;
+			record.indexed = draws[d].indexed;
+			record.count = draws[d].count;
+			record.first = draws[d].first;
+			record.baseVertex = 0;
+			records.push_back(record);
+		}
+	}
+
+	// Batches occupy consecutive ranges of the command buffer
+	GLuint commandOffset = 0;
+	for (GpuDrawBatch& batch : batches)
 	{
-		if (action == GLFW_PRESS)
-			cout << "Left mouse button pressed" << endl;
-		else
-			cout << "Left mouse button released" << endl;
+		batch.commandOffset = commandOffset;
+		commandOffset += batch.maxCount;
 	}
-	break;
+	for (GpuDrawRecord& record : records)
+		record.commandOffset = batches[record.batch].commandOffset;
 
-	case GLFW_MOUSE_BUTTON_MIDDLE:
+	gGpuDriven.SetDraws(records, batches);
+}
+
+
+// Simulation thread: frustum culls the snapshot scene and sorts it (surfaces front to back, then lights)
+void UBuildDrawOrder(FrameSnapshot& frame)
+{
+	static std::vector<float> depths;
+	const std::vector<SceneObject>& objects = frame.objects;
+	depths.resize(objects.size());
+	frame.drawOrder.clear();
+
+	for (size_t i = 0; i < objects.size(); ++i)
 	{
-		if (action == GLFW_PRESS)
-			cout << "Middle mouse button pressed" << endl;
-		else
-			cout << "Middle mouse button released" << endl;
+		const SceneObject& object = objects[i];
+		if (!UBoxInFrustum(object.boundsMin, object.boundsMax, frame.viewProjection))
+			continue;
+
+		depths[i] = -(frame.view * glm::vec4(object.center, 1.0f)).z;
+		frame.drawOrder.push_back((int)i);
 	}
-	break;
 
-	case GLFW_MOUSE_BUTTON_RIGHT:
+	std::sort(frame.drawOrder.begin(), frame.drawOrder.end(), [&objects](int a, int b)
+		{
+			if (objects[a].isLight != objects[b].isLight)
+				return !objects[a].isLight;
+			return depths[a] < depths[b];
+		});
+}
+
+
+// Render thread: drops objects hidden by the last known occlusion results from the snapshot order
+// and flags large occludees for a conservative query
+void UCullDrawOrder(const FrameSnapshot& frame)
+{
+	gDrawOrder.clear();
+	std::fill(gUseOcclusionQuery.begin(), gUseOcclusionQuery.end(), 0);
+	gQueryCount = 0;
+
+	for (int index : frame.drawOrder)
 	{
-		if (action == GLFW_PRESS)
-			cout << "Right mouse button pressed" << endl;
-		else
-			cout << "Right mouse button released" << endl;
+		if (gOcclusionCulling)
+		{
+			const SceneObject& object = gSceneObjects[index];
+
+			// Hidden by last known Hi-Z result
+			if (!gOcclusion.IsVisible(index))
+				continue;
+
+			// Large on screen: a conservative query on its box decides instead
+			if (gQueryCount < MAX_OCCLUSION_QUERIES &&
+				UScreenCoverage(object.boundsMin, object.boundsMax, frame.viewProjection) >= gOcclusion.LargeOccludeeCoverage)
+			{
+				gUseOcclusionQuery[index] = 1;
+				++gQueryCount;
+			}
+		}
+
+		gDrawOrder.push_back(index);
 	}
-	break;
+}
 
-	default:
-		cout << "Unhandled mouse button event" << endl;
-		break;
+
+// Draws an object's bounding box into its occlusion query without touching color or depth,
+// then restores the program and color mask of the pass that issued it
+void UIssueOcclusionQuery(int index, GLuint restoreProgram, GLboolean colorWrites, GLuint& boundVao)
+{
+	glUseProgram(gBoundsProgramId);
+	glUniform1ui(gBoundsBoxSlotLocation, gQueryBoxSlot[index]);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+	if (boundVao != meshes.gBoxMesh.vao)
+	{
+		glBindVertexArray(meshes.gBoxMesh.vao);
+		boundVao = meshes.gBoxMesh.vao;
 	}
+
+	glBeginQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, gOcclusion.Query(index));
+	glDrawElementsInstancedBaseInstance(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0, 1, index);
+	glEndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE);
+
+	glDepthMask(GL_TRUE);
+	glColorMask(colorWrites, colorWrites, colorWrites, colorWrites);
+	glUseProgram(restoreProgram);
 }
 
 
-// Functioned called to render a frame
-void URender()
-{
-	GLint viewPosLoc;
-	GLint ambStrLoc;
-	GLint ambColLoc;
-	GLint light1ColLoc;
-	GLint light1PosLoc;
-	GLint light2ColLoc;
-	GLint light2PosLoc;
-	GLint objectColorLoc;
-	GLint specInt1Loc;
-	GLint highlghtSz1Loc;
-	GLint specInt2Loc;
-	GLint highlghtSz2Loc;
-	GLint uHasTextureLoc;
-	GLint multipleTexturesLoc;
-
-	glm::mat4 projection;
+// Draw calls that make up a mesh; returns how many were written
+int UMeshDraws(MeshKind mesh, MeshDraw draws[MAX_MESH_DRAWS], bool lightmapped)
+{
+	// The lightmapped copy is one unrolled triangle list
+	if (lightmapped)
+	{
+		draws[0] = { GL_TRIANGLES, false, 0, gLightmapMeshes[mesh].vertexCount };
+		return 1;
+	}
 
-	// Enable z-depth
-	glEnable(GL_DEPTH_TEST);
+	switch (mesh)
+	{
+	case MESH_PLANE:
+		draws[0] = { GL_TRIANGLES, true, 0, meshes.gPlaneMesh.nIndices };
+		return 1;
+	case MESH_BOX:
+		draws[0] = { GL_TRIANGLES, true, 0, meshes.gBoxMesh.nIndices };
+		return 1;
+	case MESH_SPHERE:
+		draws[0] = { GL_TRIANGLES, true, 0, meshes.gSphereMesh.nIndices };
+		return 1;
+	case MESH_CYLINDER:
+		draws[0] = { GL_TRIANGLE_FAN, false, 0, 36 };		//bottom
+		draws[1] = { GL_TRIANGLE_FAN, false, 36, 36 };		//top
+		draws[2] = { GL_TRIANGLE_STRIP, false, 72, 146 };	//sides
+		return 3;
+	case MESH_PYRAMID4:
+		draws[0] = { GL_TRIANGLE_STRIP, false, 0, meshes.gPyramid4Mesh.nVertices };
+		return 1;
+	default:
+		return 0;
+	}
+}
 
-	// Clear the frame and z buffers
-	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	// camera/view transformation
-	glm::mat4 view = gCamera.GetViewMatrix();
+// Issues the draw calls for a mesh whose VAO is bound; the base instance selects the object data
+void UDrawMesh(MeshKind mesh, GLuint objectIndex, bool lightmapped)
+{
+	MeshDraw draws[MAX_MESH_DRAWS];
+	int drawCount = UMeshDraws(mesh, draws, lightmapped);
+	for (int d = 0; d < drawCount; ++d)
+	{
+		if (draws[d].indexed)
+			glDrawElementsInstancedBaseInstance(draws[d].mode, draws[d].count, GL_UNSIGNED_INT, (void*)(size_t)(draws[d].first * sizeof(GLuint)), 1, objectIndex);
+		else
+			glDrawArraysInstancedBaseInstance(draws[d].mode, draws[d].first, draws[d].count, 1, objectIndex);
+	}
+}
 
-	// Creates a perspective projection
-	if (gOrtho == false) {
-		projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+
+GLuint UMeshVao(MeshKind mesh, bool lightmapped)
+{
+	if (lightmapped)
+		return gLightmapMeshes[mesh].vao;
+
+	switch (mesh)
+	{
+	case MESH_PLANE: return meshes.gPlaneMesh.vao;
+	case MESH_BOX: return meshes.gBoxMesh.vao;
+	case MESH_SPHERE: return meshes.gSphereMesh.vao;
+	case MESH_CYLINDER: return meshes.gCylinderMesh.vao;
+	case MESH_PYRAMID4: return meshes.gPyramid4Mesh.vao;
+	default: return 0;
 	}
-	else {
-		projection = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, 0.1f, 100.0f);
+}
+
+
+// Writes the per-frame camera data into the streaming buffer and binds it for every scene program
+void UWriteFrameData(const glm::mat4& view, const glm::mat4& projection)
+{
+	StreamBuffer::Allocation allocation = gStream.Allocate(sizeof(FrameData));
+	if (!allocation.data)
+		return;
+
+	FrameData* frameData = (FrameData*)allocation.data;
+	frameData->view = view;
+	frameData->projection = projection;
+	frameData->uvScale = glm::vec4(gUVScale, 0.0f, 0.0f);
+	frameData->viewPosition = glm::inverse(view)[3];		// from the view drawn, so it follows the late-latched camera
+	gStream.BindRange(GL_UNIFORM_BUFFER, 0, allocation);
+}
+
+
+// CPU path: culls and sorts the draw list, then issues one draw per object
+void URenderDrawList(const FrameSnapshot& frame)
+{
+	// Pick up finished occlusion results and cull the snapshot's draw list
+	if (gOcclusionCulling)
+		gOcclusion.CollectResults();
+	UCullDrawOrder(frame);
+
+	// Box transforms of the objects tested with a query this frame
+	if (gQueryCount > 0)
+	{
+		StreamBuffer::Allocation boxes = gStream.Allocate(gQueryCount * sizeof(glm::mat4));
+		if (boxes.data)
+		{
+			glm::mat4* boxModels = (glm::mat4*)boxes.data;
+			GLuint slot = 0;
+			for (int index : gDrawOrder)
+			{
+				if (!gUseOcclusionQuery[index])
+					continue;
+
+				// Unit box scaled to the bounds; flat objects get a sliver of thickness so the box has area
+				const SceneObject& object = gSceneObjects[index];
+				glm::vec3 extent = glm::max(object.boundsMax - object.boundsMin, glm::vec3(0.01f));
+				boxModels[slot] = glm::translate((object.boundsMin + object.boundsMax) * 0.5f) * glm::scale(extent);
+				gQueryBoxSlot[index] = slot++;
+			}
+			gStream.BindRange(GL_SHADER_STORAGE_BUFFER, 6, boxes);
+		}
+		else
+		{
+			// Out of streaming space: draw everything unconditionally
+			std::fill(gUseOcclusionQuery.begin(), gUseOcclusionQuery.end(), 0);
+		}
 	}
-	// obtain the location of a uniform variable named projection in shader program so we can use UChangePerspective in main render loop
-	GLint gProjLoc = glGetUniformLocation(gSurfaceProgramId, "projection");
 
+	GLuint boundVao = 0;
 
-	// Set the shader to be used
-	glUseProgram(gSurfaceProgramId);
+	if (gDepthPrepass)
+	{
+		// Lay down depth with a trivial shader so the Phong pass shades each pixel once
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glUseProgram(gDepthProgramId);
 
-	// Retrieves and passes transform matrices to the Shader program
-	GLint modelLoc = glGetUniformLocation(gSurfaceProgramId, "model");
-	GLint viewLoc = glGetUniformLocation(gSurfaceProgramId, "view");
-	GLint projLoc = glGetUniformLocation(gSurfaceProgramId, "projection");
-	viewPosLoc = glGetUniformLocation(gSurfaceProgramId, "viewPosition");
-	ambStrLoc = glGetUniformLocation(gSurfaceProgramId, "ambientStrength");
-	ambColLoc = glGetUniformLocation(gSurfaceProgramId, "ambientColor");
-	light1ColLoc = glGetUniformLocation(gSurfaceProgramId, "light1Color");
-	light1PosLoc = glGetUniformLocation(gSurfaceProgramId, "light1Position");
-	light2ColLoc = glGetUniformLocation(gSurfaceProgramId, "light2Color");
-	light2PosLoc = glGetUniformLocation(gSurfaceProgramId, "light2Position");
-	objectColorLoc = glGetUniformLocation(gSurfaceProgramId, "objectColor");
-	specInt1Loc = glGetUniformLocation(gSurfaceProgramId, "specularIntensity1");
-	highlghtSz1Loc = glGetUniformLocation(gSurfaceProgramId, "highlightSize1");
-	specInt2Loc = glGetUniformLocation(gSurfaceProgramId, "specularIntensity2");
-	highlghtSz2Loc = glGetUniformLocation(gSurfaceProgramId, "highlightSize2");
-	uHasTextureLoc = glGetUniformLocation(gSurfaceProgramId, "ubHasTexture");
-	multipleTexturesLoc = glGetUniformLocation(gSurfaceProgramId, "multipleTextures");
-
-	GLint UVScaleLoc = glGetUniformLocation(gSurfaceProgramId, "uvScale");
-	glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
-
-	glUniform1i(multipleTexturesLoc, false);
-
-	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-	glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-	//set ambient lighting strength
-	glUniform1f(ambStrLoc, 0.9f);
-	//set ambient color
-	glUniform3f(ambColLoc, 0.4f, 0.4f, 0.4f);
-	glUniform3f(light1ColLoc, 0.0f, 0.0f, 0.0f);
-	glUniform3f(light1PosLoc, -1.0f, 4.0f, -1.0f);
-	glUniform3f(light2ColLoc, 0.0f, 0.0f, 0.0f);
-	glUniform3f(light2PosLoc, 1.0f, 4.0f, -1.0f);
-	//set specular intensity
-	glUniform1f(specInt1Loc, 0.0f);
-	glUniform1f(specInt2Loc, 0.0f);
-	//set specular highlight size
-	glUniform1f(highlghtSz1Loc, 2.0f);
-	glUniform1f(highlghtSz2Loc, 2.0f);
-
-	// Activate the VBOs contained within the mesh's VAO
-	glBindVertexArray(meshes.gPlaneMesh.vao);
-
-	// We set the texture as texture unit 0
-	glUniform1i(glGetUniformLocation(gSurfaceProgramId, "uTexture"), 1);
-
-
-	// 1. Scales the object
-	glm::mat4 scale = glm::scale(glm::vec3(6.0f, 1.0f, 4.0f));
-	// 2. Rotate the object
-	glm::mat4 rotation = glm::rotate(0.0f, glm::vec3(1.0, 1.0f, 1.0f));
-	// 3. Position the object
-	glm::mat4 translation = glm::translate(glm::vec3(0.0f, -0.5f, 0.0f));
-	// Model matrix: transformations are applied right-to-left order
-	glm::mat4 model = translation * rotation * scale;
-
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	glProgramUniform4f(gSurfaceProgramId, objectColorLoc, 1.0f, 0.0f, 0.0f, 1.0f);
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gPlaneMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+		for (int index : gDrawOrder)
+		{
+			const SceneObject& object = gSceneObjects[index];
 
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
+			// Large occludees are tested here against the depth of everything in front of them
+			if (gUseOcclusionQuery[index])
+			{
+				UIssueOcclusionQuery(index, gDepthProgramId, GL_FALSE, boundVao);
+				glBeginConditionalRender(gOcclusion.Query(index), GL_QUERY_NO_WAIT);
+			}
 
-	// Activate the VBOs contained within the mesh's VAO
-	glBindVertexArray(meshes.gBoxMesh.vao);
-
-	// We set the texture as texture unit 0
-	glUniform1i(glGetUniformLocation(gSurfaceProgramId, "uTexture"), 2);
-
-	// bool for texture
-	glUniform1i(uHasTextureLoc, true);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(8.0f, 3.0f, 4.0f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-0.5f, 1.0f, 1.0f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	glProgramUniform4f(gSurfaceProgramId, objectColorLoc, 0.5f, 0.5f, 0.0f, 1.0f);
-
-	// We set the texture as texture unit 0
-	glUniform1i(glGetUniformLocation(gSurfaceProgramId, "uTexture"), 2);
-
-	//set ambient lighting strength
-	glUniform1f(ambStrLoc, 0.9f);
-	//set ambient color
-	glUniform3f(ambColLoc, 0.3f, 0.3f, 0.3f);
-	glUniform3f(light1ColLoc, 0.0f, 0.0f, 0.0f);
-	glUniform3f(light1PosLoc, -1.0f, 4.0f, -1.0f);
-	glUniform3f(light2ColLoc, 0.0f, 0.0f, 0.0f);
-	glUniform3f(light2PosLoc, 1.0f, 4.0f, -1.0f);
-	//set specular intensity
-	glUniform1f(specInt1Loc, 0.0f);
-	glUniform1f(specInt2Loc, 0.0f);
-	//set specular highlight size
-	glUniform1f(highlghtSz1Loc, 2.0f);
-	glUniform1f(highlghtSz2Loc, 2.0f);
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gBoxMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
+			// Lightmapped objects lay down depth from the same copy of the mesh they are shaded with
+			bool lightmapped = UIsLightmapped(index);
+			GLuint vao = UMeshVao(object.mesh, lightmapped);
+			if (vao != boundVao)
+			{
+				glBindVertexArray(vao);
+				boundVao = vao;
+			}
+			UDrawMesh(object.mesh, index, lightmapped);
 
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
+			if (gUseOcclusionQuery[index])
+				glEndConditionalRender();
+		}
 
-	// Activate the VBOs contained within the mesh's VAO
-	glBindVertexArray(meshes.gSphereMesh.vao);
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.3f, 0.3f, 0.3f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(-1.0, 1.0f, -1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(0.7f, 2.8f, 1.3f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	glProgramUniform4f(gSurfaceProgramId, objectColorLoc, 0.0f, 1.0f, 0.0f, 1.0f);
-
-	// We set the texture as texture unit 0
-	glUniform1i(glGetUniformLocation(gSurfaceProgramId, "uTexture"), 4);
-
-	// bool for texture
-	glUniform1i(multipleTexturesLoc, true);
-
-	//set ambient lighting strength
-	glUniform1f(ambStrLoc, 0.45f);
-	//set ambient color
-	glUniform3f(ambColLoc, 0.6f, 0.6f, 0.6f);
-	glUniform3f(light1ColLoc, 0.2f, 0.4f, 0.2f);
-	glUniform3f(light1PosLoc, -1.0f, 4.0f, -1.0f);
-	glUniform3f(light2ColLoc, 0.0f, 0.0f, 0.0f);
-	glUniform3f(light2PosLoc, 1.0f, 4.0f, -1.0f);
-	//set specular intensity
-	glUniform1f(specInt1Loc, 0.0f);
-	glUniform1f(specInt2Loc, 0.0f);
-	//set specular highlight size
-	glUniform1f(highlghtSz1Loc, 10.0f);
-	glUniform1f(highlghtSz2Loc, 10.0f);
-
-	// Draws the triangles
-	glDrawElements(GL_TRIANGLES, meshes.gSphereMesh.nIndices, GL_UNSIGNED_INT, (void*)0);
-
-	glUniform1i(multipleTexturesLoc, false);
+		// Shading pass only touches the visible surface
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glDepthFunc(GL_EQUAL);
+		glDepthMask(GL_FALSE);
+	}
 
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
+	// Set the shader to be used
+	GLuint program = gSurfaceProgramId;
+	glUseProgram(program);
 
-	// Activate the VBOs contained within the mesh's VAO
-	glBindVertexArray(meshes.gCylinderMesh.vao);
-
-	// We set the texture as texture unit 0
-	glUniform1i(glGetUniformLocation(gSurfaceProgramId, "uTexture"), 0);
-
-
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.5f, 0.5f, 0.5f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-1.3f, 2.5f, 1.3f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	glProgramUniform4f(gSurfaceProgramId, objectColorLoc, 1.0f, 1.0f, 0.0f, 1.0f);
-
-	//set ambient lighting strength
-	glUniform1f(ambStrLoc, 0.9f);
-	//set ambient color
-	glUniform3f(ambColLoc, 0.4f, 0.4f, 0.4f);
-	glUniform3f(light1ColLoc, 0.4f, 0.4f, 0.4f);
-	glUniform3f(light1PosLoc, -1.0f, 2.7f, -1.0f);
-	glUniform3f(light2ColLoc, 0.2f, 0.2f, 0.2f);
-	glUniform3f(light2PosLoc, 1.0f, 4.0f, -1.0f);
-	//set specular intensity
-	glUniform1f(specInt1Loc, 1.8f);
-	glUniform1f(specInt2Loc, 0.2f);
-	//set specular highlight size
-	glUniform1f(highlghtSz1Loc, 2.5f);
-	glUniform1f(highlghtSz2Loc, 2.0f);
-
-	// Draws the triangles
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 36);		//bottom
-	glDrawArrays(GL_TRIANGLE_FAN, 36, 36);		//top
-	glDrawArrays(GL_TRIANGLE_STRIP, 72, 146);	//sides
+	GLint textureUnit = -1;
+	for (int index : gDrawOrder)
+	{
+		const SceneObject& object = gSceneObjects[index];
 
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
+		// Light objects are sorted after all surfaces; static surfaces use the baked lighting variant
+		bool lightmapped = UIsLightmapped(index);
+		GLuint objectProgram = object.isLight ? gLightProgramId : (lightmapped ? gLightmappedProgramId : gSurfaceProgramId);
+		if (objectProgram != program)
+		{
+			program = objectProgram;
+			glUseProgram(program);
+			textureUnit = -1;
+		}
+
+		// Large occludees: reuse the pre-pass query, or issue it now against what has been drawn so far
+		if (gUseOcclusionQuery[index])
+		{
+			if (!gDepthPrepass)
+				UIssueOcclusionQuery(index, program, GL_TRUE, boundVao);
+			glBeginConditionalRender(gOcclusion.Query(index), GL_QUERY_NO_WAIT);
+		}
+
+		// Activate the VBOs contained within the mesh's VAO
+		GLuint vao = UMeshVao(object.mesh, lightmapped);
+		if (vao != boundVao)
+		{
+			glBindVertexArray(vao);
+			boundVao = vao;
+		}
+
+		// Select the object's texture unit
+		if (!object.isLight && object.material.textureUnit != textureUnit)
+		{
+			textureUnit = object.material.textureUnit;
+			glUniform1i(lightmapped ? gLightmappedUniforms.texture : gSurfaceUniforms.texture, textureUnit);
+		}
 
-	// Activate the VBOs contained within the mesh's VAO
-	glBindVertexArray(meshes.gCylinderMesh.vao);
+		// Draws the triangles
+		UDrawMesh(object.mesh, index, lightmapped);
 
-	// We set the texture as texture unit 0
-	glUniform1i(glGetUniformLocation(gSurfaceProgramId, "uTexture"), 3);
+		if (gUseOcclusionQuery[index])
+			glEndConditionalRender();
+	}
+}
 
-	// 1. Scales the object
-	scale = glm::scale(glm::vec3(0.5f, 0.1f, 0.5f));
-	// 2. Rotate the object
-	rotation = glm::rotate(0.0f, glm::vec3(1.0, 1.0f, 1.0f));
-	// 3. Position the object
-	translation = glm::translate(glm::vec3(-1.3f, 3.0f, 1.3f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
 
-	glProgramUniform4f(gSurfaceProgramId, objectColorLoc, 1.0f, 0.0f, 0.0f, 1.0f);
+// GPU-driven path: a compute shader culls and writes the indirect commands, then one multi-draw per batch
+void URenderIndirect(const glm::mat4& viewProjection)
+{
+	gGpuDriven.Cull(viewProjection, gOcclusion, gOcclusionCulling);
+	const std::vector<GpuDrawBatch>& batches = gGpuDriven.Batches();
 
+	if (gDepthPrepass)
+	{
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glUseProgram(gDepthProgramId);
+		for (size_t b = 0; b < batches.size(); ++b)
+			gGpuDriven.DrawBatch(b);
+
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glDepthFunc(GL_EQUAL);
+		glDepthMask(GL_FALSE);
+	}
 
-	// Draws the triangles
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 36);		//bottom
-	glDrawArrays(GL_TRIANGLE_FAN, 36, 36);		//top
-	glDrawArrays(GL_TRIANGLE_STRIP, 72, 146);	//sides
+	// Surfaces, then the static surfaces with baked lighting
+	glUseProgram(gSurfaceProgramId);
+	for (size_t b = 0; b < batches.size(); ++b)
+	{
+		if (batches[b].isLight || batches[b].lightmapped)
+			continue;
+		glUniform1i(gSurfaceUniforms.texture, batches[b].textureUnit);
+		gGpuDriven.DrawBatch(b);
+	}
+	glUseProgram(gLightmappedProgramId);
+	for (size_t b = 0; b < batches.size(); ++b)
+	{
+		if (batches[b].isLight || !batches[b].lightmapped)
+			continue;
+		glUniform1i(gLightmappedUniforms.texture, batches[b].textureUnit);
+		gGpuDriven.DrawBatch(b);
+	}
 
-		// Set the shader to be used
+	// Light objects
 	glUseProgram(gLightProgramId);
+	for (size_t b = 0; b < batches.size(); ++b)
+	{
+		if (batches[b].isLight)
+			gGpuDriven.DrawBatch(b);
+	}
+}
+
+
+// Functioned called to render a frame
+void URender(const FrameSnapshot& frame)
+{
+	// A new scene arrived with the snapshot: refresh the render thread's copy and the GPU buffers
+	if (frame.sceneVersion != gUploadedSceneVersion)
+	{
+		gSceneObjects = frame.objects;
+		UUploadScene();
+		gUploadedSceneVersion = frame.sceneVersion;
 
-	// Retrieves and passes transform matrices to the Shader program
-	modelLoc = glGetUniformLocation(gLightProgramId, "model");
-	viewLoc = glGetUniformLocation(gLightProgramId, "view");
-	projLoc = glGetUniformLocation(gLightProgramId, "projection");
+		gMipSweepNext = 0;
+		std::fill(gMipSweepTexels, gMipSweepTexels + SCENE_TEXTURE_UNITS, 0.0f);
+		std::fill(gMipSweptTexels, gMipSweptTexels + SCENE_TEXTURE_UNITS, 0.0f);
+	}
 
-	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-	glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+	// Stream texture mips toward what the visible objects need; keep drawing until they arrive
+	URequestTextureMips(frame);
+	if (gTextureStreamer.Update())
+		URequestRedraw(1);
 
-	// Activate the VBOs contained within the mesh's VAO
-	glBindVertexArray(meshes.gPyramid4Mesh.vao);
+	// Take this frame's region of the streaming buffer
+	gStream.BeginFrame();
 
-	// 1. Scales the object by 2
-	scale = glm::scale(glm::vec3(0.4f, 0.4f, 0.4f));
-	// 2. Rotates shape by 15 degrees in the x axis
-	rotation = glm::rotate(-0.2f, glm::vec3(1.0, 0.0f, 0.0f));
-	// 3. Place object at the origin
-	translation = glm::translate(glm::vec3(-1.0f, 2.7f, -1.0f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
+	// Latest view; the resizes and clicks late latching may poll are held for the loop to apply after the frame
+	glm::mat4 view;
+	double inputTime = ULatchCamera(frame, view);
+	glm::mat4 viewProjection = frame.projection * view;
 
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+	// Render into the offscreen target at the current resolution scale
+	gDynamicResolution.BeginFrame();
 
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, meshes.gPyramid4Mesh.nVertices);
+	// Enable z-depth
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
 
-	// 1. Scales the object by 2
-	scale = glm::scale(glm::vec3(0.4f, 0.4f, 0.4f));
-	// 2. Rotates shape by 15 degrees in the x axis
-	rotation = glm::rotate(-0.2f, glm::vec3(1.0, 0.0f, 0.0f));
-	// 3. Place object at the origin
-	translation = glm::translate(glm::vec3(1.5f, 5.0f, 1.0f));
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
+	// Clear the frame and z buffers
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+	// camera/view transformation; the CPU draw list stays culled with the snapshot's view, which the
+	// latched one differs from only by the last few milliseconds of mouse look
+	UWriteFrameData(view, frame.projection);
 
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, meshes.gPyramid4Mesh.nVertices);
+	// A snapshot taken before a switch to the CPU path has no draw list yet; the GPU path draws it
+	bool gpuDriven = gGpuDrivenRendering || !frame.hasDrawOrder;
+	if (gpuDriven)
+		URenderIndirect(viewProjection);
+	else
+		URenderDrawList(frame);
 
 	// Deactivate the Vertex Array Object
 	glBindVertexArray(0);
 
+	// Restore default depth state (glClear honors the depth mask)
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
 
+	// Build the Hi-Z pyramid from this frame; the CPU path also tests the scene against it for the frames ahead
+	if (gOcclusionCulling)
+	{
+		gOcclusion.BuildHiz(gDynamicResolution.Fbo(), gDynamicResolution.RenderWidth(), gDynamicResolution.RenderHeight());
+		if (!gpuDriven)
+			gOcclusion.TestObjects(viewProjection);
+	}
+
+	// Upscale and sharpen into the window
+	gDynamicResolution.Present();
+
+	// Queue the finished frame's readback; it is encoded a few frames later on the capture threads
+	if (gFrameCapture.Recording())
+	{
+		int width, height;
+		glfwGetFramebufferSize(gWindow, &width, &height);
+		gFrameCapture.Capture(width, height);
+	}
+
+	// Everything reading this frame's streamed data has been submitted
+	gStream.EndFrame();
 
-	
 	// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
 	glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+
+	// Timestamp the present for the latency report and bound the frames queued on the GPU
+	gFramePacer.EndFrame(inputTime);
 }
 
-/*Generate and load the texture*/
-bool UCreateTexture(const char* filename, GLuint& textureId)
+
+// Starts a new take at the window's current size, or ends the one being recorded
+void UToggleRecording()
 {
-	int width, height, channels;
-	unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
-	if (image)
+	if (gFrameCapture.Recording())
 	{
-		flipImageVertically(image, width, height, channels);
+		gFrameCapture.Stop();
+		return;
+	}
 
-		glGenTextures(1, &textureId);
-		glBindTexture(GL_TEXTURE_2D, textureId);
+	int width, height;
+	glfwGetFramebufferSize(gWindow, &width, &height);
+	if (gFrameCapture.Start(CAPTURE_PREFIX, gRecordFormat, width, height))
+		URequestRedraw();
+}
 
-		// set the texture wrapping parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		// set texture filtering parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-		if (channels == 3)
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-		else if (channels == 4)
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-		else
+// Render thread: the view to draw a snapshot with. With late latching, events are polled once more and the mouse
+// look the simulation has not applied yet goes onto a copy of the snapshot's camera. Returns when the oldest mouse
+// move drawn for the first time was reported, negative for none.
+double ULatchCamera(const FrameSnapshot& frame, glm::mat4& view)
+{
+	view = frame.view;
+	unsigned long long drawn = frame.lookSequence;
+	if (gLateLatch && !frame.ortho)
+	{
+		glfwPollEvents();
+		Camera camera = frame.camera;
+		for (const PendingLook& look : gPendingLook)
 		{
-			cout << "Not implemented to handle image with " << channels << " channels" << endl;
-			return false;
+			if (look.sequence > frame.lookSequence)
+				camera.ProcessMouseMovement(look.x, look.y);
+		}
+		view = camera.GetViewMatrix();
+		drawn = gLookSequence;
+	}
+
+	// Mouse look does not move the orthographic view, so its moves are not timed
+	double inputTime = -1.0;
+	for (const PendingLook& look : gPendingLook)
+	{
+		if (look.sequence > gDisplayedLook && look.sequence <= drawn && !frame.ortho)
+		{
+			inputTime = look.time;
+			break;
 		}
+	}
+	gDisplayedLook = std::max(gDisplayedLook, drawn);
 
-		glGenerateMipmap(GL_TEXTURE_2D);
+	// The simulation owns the moves this snapshot contains
+	while (!gPendingLook.empty() && gPendingLook.front().sequence <= frame.lookSequence)
+		gPendingLook.pop_front();
+	return inputTime;
+}
 
-		stbi_image_free(image);
-		glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
+/*Load the texture and hand it to the streamer*/
+bool UCreateTexture(const char* filename, int textureUnit)
+{
+	int width, height, channels;
+	unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
+	if (image)
+	{
+		flipImageVertically(image, width, height, channels);
+
+		// The streamer keeps its own copy with the mip chain
+		bool added = gTextureStreamer.Add(textureUnit, image, width, height, channels);
 
-		return true;
+		stbi_image_free(image);
+		return added;
 	}
 
 	// Error loading the image
@@ -988,9 +2747,75 @@ bool UCreateTexture(const char* filename, GLuint& textureId)
 }
 
 
-void UDestroyTexture(GLuint textureId)
+// Projected size in texels of an object's textures, tiling included
+float UProjectedTexels(const FrameSnapshot& frame, const SceneObject& object)
+{
+	bool perspective = frame.projection[3][3] == 0.0f;
+	float pixelsPerUnit = 0.5f * frame.projection[1][1] * gDynamicResolution.RenderHeight();
+	float tiling = std::max(gUVScale.x, gUVScale.y);
+
+	float diameter = glm::length(object.boundsMax - object.boundsMin);
+	float pixels = diameter * pixelsPerUnit;
+	if (perspective)
+	{
+		// Nearest point of the bounding sphere, kept in front of the near plane
+		float distance = glm::length(glm::vec3(frame.view * glm::vec4(object.center, 1.0f))) - 0.5f * diameter;
+		pixels /= std::max(distance, 0.1f);
+	}
+	return pixels * tiling;
+}
+
+
+// Reports the visible objects' projected sizes in texels, for the textures they sample: from the
+// draw list on the CPU path, from a sweep amortized over frames on the GPU-driven path
+void URequestTextureMips(const FrameSnapshot& frame)
 {
-	glGenTextures(1, &textureId);
+	if (frame.hasDrawOrder)
+	{
+		for (int index : frame.drawOrder)
+		{
+			const SceneObject& object = gSceneObjects[index];
+			if (object.isLight || !object.material.hasTexture)
+				continue;
+
+			float texels = UProjectedTexels(frame, object);
+			gTextureStreamer.Request(object.material.textureUnit, texels);
+			if (object.material.multipleTextures)
+				gTextureStreamer.Request(EXTRA_TEXTURE_UNIT, texels);
+		}
+		return;
+	}
+
+	size_t count = gSceneObjects.size();
+	size_t end = std::min(gMipSweepNext + MIP_SWEEP_OBJECTS, count);
+	for (size_t index = gMipSweepNext; index < end; ++index)
+	{
+		const SceneObject& object = gSceneObjects[index];
+		int unit = object.material.textureUnit;
+		if (object.isLight || !object.material.hasTexture || unit < 0 || unit >= SCENE_TEXTURE_UNITS ||
+			!UBoxInFrustum(object.boundsMin, object.boundsMax, frame.viewProjection))
+			continue;
+
+		float texels = UProjectedTexels(frame, object);
+		gMipSweepTexels[unit] = std::max(gMipSweepTexels[unit], texels);
+		if (object.material.multipleTextures)
+			gMipSweepTexels[EXTRA_TEXTURE_UNIT] = std::max(gMipSweepTexels[EXTRA_TEXTURE_UNIT], texels);
+	}
+
+	gMipSweepNext = end;
+	if (gMipSweepNext >= count)
+	{
+		std::copy(gMipSweepTexels, gMipSweepTexels + SCENE_TEXTURE_UNITS, gMipSweptTexels);
+		std::fill(gMipSweepTexels, gMipSweepTexels + SCENE_TEXTURE_UNITS, 0.0f);
+		gMipSweepNext = 0;
+	}
+
+	for (int unit = 0; unit < SCENE_TEXTURE_UNITS; ++unit)
+	{
+		float texels = std::max(gMipSweepTexels[unit], gMipSweptTexels[unit]);
+		if (texels > 0.0f)
+			gTextureStreamer.Request(unit, texels);
+	}
 }
 
 // Implements the UCreateShaders function
@@ -1018,7 +2843,7 @@ bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSou
 	if (!success)
 	{
 		glGetShaderInfoLog(vertexShaderId, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+		ULOG_ERROR("ERROR::SHADER::VERTEX::COMPILATION_FAILED\n%s", infoLog);
 
 		return false;
 	}
@@ -1029,7 +2854,7 @@ bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSou
 	if (!success)
 	{
 		glGetShaderInfoLog(fragmentShaderId, sizeof(infoLog), NULL, infoLog);
-		std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+		ULOG_ERROR("ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n%s", infoLog);
 
 		return false;
 	}
@@ -1044,7 +2869,7 @@ bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSou
 	if (!success)
 	{
 		glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
-		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+		ULOG_ERROR("ERROR::SHADER::PROGRAM::LINKING_FAILED\n%s", infoLog);
 
 		return false;
 	}
@@ -1060,3 +2885,59 @@ void UDestroyShaderProgram(GLuint programId)
 	glDeleteProgram(programId);
 }
 
+
+// Compiles and links a compute-only shader program
+bool UCreateComputeProgram(const char* computeShaderSource, GLuint& programId)
+{
+	return UCreateComputeProgram(&computeShaderSource, 1, programId);
+}
+
+
+// Compiles and links a compute-only shader program from several source strings (header first)
+bool UCreateComputeProgram(const char* const* computeShaderSources, GLsizei count, GLuint& programId)
+{
+	// Compilation and linkage error reporting
+	int success = 0;
+	char infoLog[512];
+
+	programId = glCreateProgram();
+	GLuint computeShaderId = glCreateShader(GL_COMPUTE_SHADER);
+
+	glShaderSource(computeShaderId, count, computeShaderSources, NULL);
+	glCompileShader(computeShaderId);
+	// check for shader compile errors
+	glGetShaderiv(computeShaderId, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		glGetShaderInfoLog(computeShaderId, sizeof(infoLog), NULL, infoLog);
+		ULOG_ERROR("ERROR::SHADER::COMPUTE::COMPILATION_FAILED\n%s", infoLog);
+
+		return false;
+	}
+
+	glAttachShader(programId, computeShaderId);
+	glLinkProgram(programId);
+	// check for linking errors
+	glGetProgramiv(programId, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+		ULOG_ERROR("ERROR::SHADER::PROGRAM::LINKING_FAILED\n%s", infoLog);
+
+		return false;
+	}
+
+	glDeleteShader(computeShaderId); // owned by the program now
+
+	return true;
+}
+
+
+// Looks up the uniform locations used every frame so the render loop does not query them
+void UCacheUniformLocations()
+{
+	gSurfaceUniforms.texture = glGetUniformLocation(gSurfaceProgramId, "uTexture");
+	gLightmappedUniforms.texture = glGetUniformLocation(gLightmappedProgramId, "uTexture");
+	gBoundsBoxSlotLocation = glGetUniformLocation(gBoundsProgramId, "boxSlot");
+}
+
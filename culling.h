@@ -0,0 +1,490 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <GL/glew.h>        // GLEW library
+
+#include <cmath>            // log2, floor
+#include <vector>
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+/*Shader program Macro*/
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+
+/*Shader snippet Macro, for source strings appended after a GLSL() header*/
+#ifndef GLSL_SOURCE
+#define GLSL_SOURCE(Source) #Source "\n"
+#endif
+
+// Source.cpp
+bool UCreateComputeProgram(const char* computeShaderSource, GLuint& programId);
+bool UCreateComputeProgram(const char* const* computeShaderSources, GLsizei count, GLuint& programId);
+
+/* Visibility culling
+ * ------------------
+ * Frustum culling runs on the CPU against world-space bounds.
+ *
+ * Occlusion culling keeps a hierarchical-Z (Hi-Z) pyramid: after a frame is drawn its depth
+ * buffer is copied, reduced to a max-depth mip chain, and every object's bounds are tested
+ * against it in a compute shader. Results land in a small ring of readback buffers guarded
+ * by fences and are only read once the GPU has finished with them, so the CPU never waits;
+ * the price is one or two frames of latency before a newly revealed object appears.
+ *
+ * Large occludees, where a coarse Hi-Z texel is too conservative to cull anything, use
+ * GL_ANY_SAMPLES_PASSED_CONSERVATIVE queries on their bounding box followed by
+ * glBeginConditionalRender(GL_QUERY_NO_WAIT), which draws if the result is not ready yet.
+ */
+
+// Copies the depth buffer into level 0 of the Hi-Z pyramid
+const GLchar* hizCopyComputeShaderSource = GLSL(440,
+	layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(binding = 7) uniform sampler2D depthTexture;
+layout(binding = 0, r32f) writeonly uniform image2D hizLevel;
+
+void main()
+{
+	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 size = imageSize(hizLevel);
+	if (texel.x >= size.x || texel.y >= size.y)
+		return;
+
+	imageStore(hizLevel, texel, vec4(texelFetch(depthTexture, texel, 0).r));
+}
+);
+
+// Reduces one Hi-Z level into the next, keeping the farthest depth
+const GLchar* hizDownsampleComputeShaderSource = GLSL(440,
+	layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(binding = 0, r32f) readonly uniform image2D srcLevel;
+layout(binding = 1, r32f) writeonly uniform image2D dstLevel;
+
+void main()
+{
+	ivec2 dst = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 dstSize = imageSize(dstLevel);
+	if (dst.x >= dstSize.x || dst.y >= dstSize.y)
+		return;
+
+	// 2x2 footprint, widened on the last row/column of odd-sized levels so no texel is dropped
+	ivec2 srcSize = imageSize(srcLevel);
+	ivec2 first = dst * 2;
+	ivec2 last = first + ivec2(1);
+	if (dst.x == dstSize.x - 1 && (srcSize.x & 1) != 0)
+		last.x += 1;
+	if (dst.y == dstSize.y - 1 && (srcSize.y & 1) != 0)
+		last.y += 1;
+	last = min(last, srcSize - ivec2(1));
+
+	float depth = 0.0;
+	for (int y = first.y; y <= last.y; ++y)
+		for (int x = first.x; x <= last.x; ++x)
+			depth = max(depth, imageLoad(srcLevel, ivec2(x, y)).r);
+
+	imageStore(dstLevel, dst, vec4(depth));
+}
+);
+
+// Frustum and Hi-Z test of a world-space box, shared by the compute programs that cull against the pyramid
+const GLchar* hizVisibilityShaderSource = GLSL_SOURCE(
+uniform mat4 viewProjection;
+uniform int hizLevels;
+uniform bool hizValid; // false until a pyramid has been built
+layout(binding = 7) uniform sampler2D hiz;
+
+bool UBoundsVisible(vec3 boundsMin, vec3 boundsMax)
+{
+	vec2 ndcMin = vec2(1.0);
+	vec2 ndcMax = vec2(-1.0);
+	float nearest = 1.0;
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		vec3 position = mix(boundsMin, boundsMax, vec3(ivec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1)));
+		vec4 clip = viewProjection * vec4(position, 1.0);
+		if (clip.w <= 0.0)
+			return true; // bounds cross the camera plane
+		vec3 ndc = clip.xyz / clip.w;
+		ndcMin = min(ndcMin, ndc.xy);
+		ndcMax = max(ndcMax, ndc.xy);
+		nearest = min(nearest, ndc.z * 0.5 + 0.5);
+	}
+
+	// Outside the frustum
+	if (ndcMin.x > 1.0 || ndcMin.y > 1.0 || ndcMax.x < -1.0 || ndcMax.y < -1.0 || nearest > 1.0)
+		return false;
+
+	if (!hizValid)
+		return true;
+
+	// Pick the level where the screen rectangle spans at most 2x2 texels
+	vec2 uvMin = clamp(ndcMin * 0.5 + 0.5, 0.0, 1.0);
+	vec2 uvMax = clamp(ndcMax * 0.5 + 0.5, 0.0, 1.0);
+	ivec2 baseSize = textureSize(hiz, 0);
+	vec2 extent = (uvMax - uvMin) * vec2(baseSize);
+	int level = int(clamp(ceil(log2(max(max(extent.x, extent.y), 1.0))), 0.0, float(hizLevels - 1)));
+
+	// Texels come from the level-0 footprint shifted down, clamped into the level; that is exactly
+	// the texel whose reduction covers them, including the widened last row/column of odd levels
+	ivec2 levelSize = textureSize(hiz, level);
+	ivec2 baseMax = baseSize - ivec2(1);
+	ivec2 texelMin = min(clamp(ivec2(uvMin * vec2(baseSize)), ivec2(0), baseMax) >> level, levelSize - ivec2(1));
+	ivec2 texelMax = min(clamp(ivec2(uvMax * vec2(baseSize)), ivec2(0), baseMax) >> level, levelSize - ivec2(1));
+
+	float farthest = max(max(texelFetch(hiz, texelMin, level).r, texelFetch(hiz, ivec2(texelMax.x, texelMin.y), level).r),
+		max(texelFetch(hiz, ivec2(texelMin.x, texelMax.y), level).r, texelFetch(hiz, texelMax, level).r));
+
+	return nearest <= farthest;
+}
+);
+
+// Tests object bounds against the Hi-Z pyramid and writes one visibility flag per object
+const GLchar* hizTestComputeShaderSource = GLSL(440,
+	layout(local_size_x = 64) in;
+
+struct ObjectBounds
+{
+	vec4 boundsMin;
+	vec4 boundsMax;
+};
+
+layout(std430, binding = 0) readonly buffer BoundsBuffer { ObjectBounds bounds[]; };
+layout(std430, binding = 1) writeonly buffer VisibilityBuffer { uint visible[]; };
+
+uniform uint objectCount;
+);
+
+const GLchar* hizTestComputeMainSource = GLSL_SOURCE(
+void main()
+{
+	uint index = gl_GlobalInvocationID.x;
+	if (index >= objectCount)
+		return;
+
+	visible[index] = UBoundsVisible(bounds[index].boundsMin.xyz, bounds[index].boundsMax.xyz) ? 1u : 0u;
+}
+);
+
+
+// True when the world-space box intersects the view frustum of viewProjection
+inline bool UBoxInFrustum(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& viewProjection)
+{
+	// Frustum planes from the rows of the matrix (Gribb/Hartmann)
+	glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+	glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+	glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+	glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+	const glm::vec4 planes[6] = { row3 + row0, row3 - row0, row3 + row1, row3 - row1, row3 + row2, row3 - row2 };
+
+	for (const glm::vec4& plane : planes)
+	{
+		// Box corner farthest along the plane normal
+		glm::vec3 positive(plane.x >= 0.0f ? boundsMax.x : boundsMin.x,
+			plane.y >= 0.0f ? boundsMax.y : boundsMin.y,
+			plane.z >= 0.0f ? boundsMax.z : boundsMin.z);
+		if (plane.x * positive.x + plane.y * positive.y + plane.z * positive.z + plane.w < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+
+// Fraction of the screen covered by the projected box; negative when the box crosses the near plane
+inline float UScreenCoverage(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& viewProjection)
+{
+	glm::vec2 ndcMin(1.0f, 1.0f);
+	glm::vec2 ndcMax(-1.0f, -1.0f);
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		glm::vec3 position((corner & 1) ? boundsMax.x : boundsMin.x,
+			(corner & 2) ? boundsMax.y : boundsMin.y,
+			(corner & 4) ? boundsMax.z : boundsMin.z);
+		glm::vec4 clip = viewProjection * glm::vec4(position, 1.0f);
+		if (clip.w <= 0.0f || clip.z < -clip.w)
+			return -1.0f;
+		ndcMin.x = fminf(ndcMin.x, clip.x / clip.w);
+		ndcMin.y = fminf(ndcMin.y, clip.y / clip.w);
+		ndcMax.x = fmaxf(ndcMax.x, clip.x / clip.w);
+		ndcMax.y = fmaxf(ndcMax.y, clip.y / clip.w);
+	}
+	float width = fmaxf(0.0f, fminf(ndcMax.x, 1.0f) - fmaxf(ndcMin.x, -1.0f));
+	float height = fmaxf(0.0f, fminf(ndcMax.y, 1.0f) - fmaxf(ndcMin.y, -1.0f));
+	return width * height * 0.25f;
+}
+
+
+class OcclusionCuller
+{
+public:
+	// Objects covering more of the screen than this use hardware queries instead of Hi-Z
+	float LargeOccludeeCoverage = 0.15f;
+
+	bool Initialize(int width, int height)
+	{
+		const char* testSources[] = { hizTestComputeShaderSource, hizVisibilityShaderSource, hizTestComputeMainSource };
+		if (!UCreateComputeProgram(hizCopyComputeShaderSource, mCopyProgramId) ||
+			!UCreateComputeProgram(hizDownsampleComputeShaderSource, mDownsampleProgramId) ||
+			!UCreateComputeProgram(testSources, 3, mTestProgramId))
+			return false;
+
+		mViewProjectionLoc = glGetUniformLocation(mTestProgramId, "viewProjection");
+		mObjectCountLoc = glGetUniformLocation(mTestProgramId, "objectCount");
+		mHizLevelsLoc = glGetUniformLocation(mTestProgramId, "hizLevels");
+		mHizValidLoc = glGetUniformLocation(mTestProgramId, "hizValid");
+
+		glGenBuffers(1, &mBoundsBuffer);
+		glGenBuffers(RESULT_SLOTS, mResultBuffers);
+		glGenFramebuffers(1, &mDepthFbo);
+
+		mInitialized = true;
+		Resize(width, height);
+		return true;
+	}
+
+	void Destroy()
+	{
+		if (!mInitialized)
+			return;
+
+		ReleaseTargets();
+		for (int i = 0; i < RESULT_SLOTS; ++i)
+		{
+			if (mFences[i])
+				glDeleteSync(mFences[i]);
+			mFences[i] = 0;
+		}
+		glDeleteFramebuffers(1, &mDepthFbo);
+		glDeleteBuffers(1, &mBoundsBuffer);
+		glDeleteBuffers(RESULT_SLOTS, mResultBuffers);
+		if (!mQueries.empty())
+			glDeleteQueries((GLsizei)mQueries.size(), mQueries.data());
+		mQueries.clear();
+		glDeleteProgram(mCopyProgramId);
+		glDeleteProgram(mDownsampleProgramId);
+		glDeleteProgram(mTestProgramId);
+		mInitialized = false;
+	}
+
+	// (Re)creates the depth copy and the Hi-Z pyramid for a framebuffer size
+	void Resize(int width, int height)
+	{
+		if (!mInitialized || width <= 0 || height <= 0 || (width == mWidth && height == mHeight))
+			return;
+
+		ReleaseTargets();
+		mWidth = width;
+		mHeight = height;
+		mLevels = (int)std::floor(std::log2((float)(width > height ? width : height))) + 1;
+
+		// Must match the depth format of the dynamic-resolution target (DynamicResolution::Resize), the blit source
+		glGenTextures(1, &mDepthTexture);
+		glBindTexture(GL_TEXTURE_2D, mDepthTexture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH24_STENCIL8, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		glGenTextures(1, &mHizTexture);
+		glBindTexture(GL_TEXTURE_2D, mHizTexture);
+		glTexStorage2D(GL_TEXTURE_2D, mLevels, GL_R32F, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, mDepthFbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, mDepthTexture, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		// Old results were computed at another resolution; start over with everything visible
+		mVisible.assign(mObjectCount, 1);
+		mHasHiz = false;
+	}
+
+	// Uploads world-space bounds; call whenever objects are added, removed or moved
+	void SetObjectBounds(const std::vector<glm::vec3>& boundsMin, const std::vector<glm::vec3>& boundsMax)
+	{
+		mObjectCount = (GLuint)boundsMin.size();
+
+		std::vector<glm::vec4> data(mObjectCount * 2);
+		for (GLuint i = 0; i < mObjectCount; ++i)
+		{
+			data[i * 2] = glm::vec4(boundsMin[i], 1.0f);
+			data[i * 2 + 1] = glm::vec4(boundsMax[i], 1.0f);
+		}
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, mBoundsBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, data.size() * sizeof(glm::vec4), data.data(), GL_STATIC_DRAW);
+		for (int i = 0; i < RESULT_SLOTS; ++i)
+		{
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, mResultBuffers[i]);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, (mObjectCount ? mObjectCount : 1) * sizeof(GLuint), NULL, GL_DYNAMIC_READ);
+			mSlotObjectCount[i] = 0;
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		mVisible.assign(mObjectCount, 1);
+	}
+
+	// Reads back any finished test results without blocking; call at the start of a frame
+	void CollectResults()
+	{
+		for (int n = 0; n < RESULT_SLOTS; ++n)
+		{
+			int slot = (mReadSlot + n) % RESULT_SLOTS;
+			if (!mFences[slot])
+				continue;
+
+			GLenum status = glClientWaitSync(mFences[slot], 0, 0);
+			if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+				break; // results complete in order, later slots are not ready either
+
+			glDeleteSync(mFences[slot]);
+			mFences[slot] = 0;
+			mReadSlot = (slot + 1) % RESULT_SLOTS;
+
+			if (mSlotObjectCount[slot] != mObjectCount)
+				continue; // stale, the scene changed since the test was issued
+
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, mResultBuffers[slot]);
+			glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, mObjectCount * sizeof(GLuint), mVisible.data());
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		}
+	}
+
+	// Latest known Hi-Z result for an object; visible until proven otherwise
+	bool IsVisible(int index) const
+	{
+		return index >= (int)mVisible.size() || mVisible[index] != 0;
+	}
+
+	// Query object used for conditional rendering of a large occludee
+	GLuint Query(int index)
+	{
+		if (index >= (int)mQueries.size())
+		{
+			size_t first = mQueries.size();
+			mQueries.resize(index + 1);
+			glGenQueries((GLsizei)(mQueries.size() - first), &mQueries[first]);
+		}
+		return mQueries[index];
+	}
+
+	// Pyramid state for compute programs that include hizVisibilityShaderSource
+	bool HasHiz() const { return mHasHiz; }
+	GLuint HizTexture() const { return mHizTexture; }
+	int HizLevels() const { return mLevels; }
+	GLuint BoundsBuffer() const { return mBoundsBuffer; }
+
+	// Builds the Hi-Z pyramid from the depth of the frame just drawn
+	void BuildHiz(GLuint sourceFbo, int sourceWidth, int sourceHeight)
+	{
+		if (!mInitialized)
+			return;
+
+		// Copy the rendered depth; a smaller rendered rectangle is stretched over the full pyramid
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, sourceFbo);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mDepthFbo);
+		glBlitFramebuffer(0, 0, sourceWidth, sourceHeight, 0, 0, mWidth, mHeight, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		// Level 0
+		glActiveTexture(GL_TEXTURE7);
+		glBindTexture(GL_TEXTURE_2D, mDepthTexture);
+		glUseProgram(mCopyProgramId);
+		glBindImageTexture(0, mHizTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		glDispatchCompute((mWidth + 7) / 8, (mHeight + 7) / 8, 1);
+
+		// Max-reduce down the chain
+		glUseProgram(mDownsampleProgramId);
+		int levelWidth = mWidth;
+		int levelHeight = mHeight;
+		for (int level = 1; level < mLevels; ++level)
+		{
+			levelWidth = levelWidth > 1 ? levelWidth / 2 : 1;
+			levelHeight = levelHeight > 1 ? levelHeight / 2 : 1;
+
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+			glBindImageTexture(0, mHizTexture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+			glBindImageTexture(1, mHizTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+			glDispatchCompute((levelWidth + 7) / 8, (levelHeight + 7) / 8, 1);
+		}
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+		mHasHiz = true;
+	}
+
+	// Tests every object's bounds against the pyramid; results are picked up by CollectResults
+	void TestObjects(const glm::mat4& viewProjection)
+	{
+		if (!mInitialized || !mHasHiz || mObjectCount == 0)
+			return;
+
+		// Never wait on the GPU: skip the test if the slot is still in flight
+		if (mFences[mWriteSlot])
+			return;
+
+		glActiveTexture(GL_TEXTURE7);
+		glBindTexture(GL_TEXTURE_2D, mHizTexture);
+		glUseProgram(mTestProgramId);
+		glUniformMatrix4fv(mViewProjectionLoc, 1, GL_FALSE, glm::value_ptr(viewProjection));
+		glUniform1ui(mObjectCountLoc, mObjectCount);
+		glUniform1i(mHizLevelsLoc, mLevels);
+		glUniform1i(mHizValidLoc, GL_TRUE);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mBoundsBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, mResultBuffers[mWriteSlot]);
+		glDispatchCompute((mObjectCount + 63) / 64, 1, 1);
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+		mFences[mWriteSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		mSlotObjectCount[mWriteSlot] = mObjectCount;
+		mWriteSlot = (mWriteSlot + 1) % RESULT_SLOTS;
+	}
+
+private:
+	void ReleaseTargets()
+	{
+		if (mDepthTexture)
+			glDeleteTextures(1, &mDepthTexture);
+		if (mHizTexture)
+			glDeleteTextures(1, &mHizTexture);
+		mDepthTexture = 0;
+		mHizTexture = 0;
+		mWidth = 0;
+		mHeight = 0;
+	}
+
+	static const int RESULT_SLOTS = 3;
+
+	bool mInitialized = false;
+	bool mHasHiz = false;
+	int mWidth = 0;
+	int mHeight = 0;
+	int mLevels = 0;
+
+	GLuint mCopyProgramId = 0;
+	GLuint mDownsampleProgramId = 0;
+	GLuint mTestProgramId = 0;
+	GLint mViewProjectionLoc = -1;
+	GLint mObjectCountLoc = -1;
+	GLint mHizLevelsLoc = -1;
+	GLint mHizValidLoc = -1;
+
+	GLuint mDepthFbo = 0;
+	GLuint mDepthTexture = 0;
+	GLuint mHizTexture = 0;
+
+	GLuint mObjectCount = 0;
+	GLuint mBoundsBuffer = 0;
+	GLuint mResultBuffers[RESULT_SLOTS] = {};
+	GLsync mFences[RESULT_SLOTS] = {};
+	GLuint mSlotObjectCount[RESULT_SLOTS] = {};
+	int mWriteSlot = 0;
+	int mReadSlot = 0;
+
+	std::vector<GLuint> mVisible;
+	std::vector<GLuint> mQueries;
+};
+
+#endif // CULLING_H
@@ -0,0 +1,303 @@
+#ifndef DYNAMICRESOLUTION_H
+#define DYNAMICRESOLUTION_H
+
+#include <GL/glew.h>        // GLEW library
+
+#include <algorithm>
+#include <cmath>            // sqrt, fabs
+
+#include "log.h"
+
+/*Shader program Macro*/
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+
+// Source.cpp
+bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
+
+/* Dynamic resolution
+ * ------------------
+ * The scene is drawn into an offscreen framebuffer allocated at the window size, of which
+ * only the lower-left scale * size rectangle is used; changing the scale never reallocates.
+ * Every frame is bracketed by a GL_TIME_ELAPSED query. Results are read from a small ring
+ * once available, so the controller works on GPU times one to three frames old and never
+ * stalls. The controller drives the pixel count toward the frame budget (pixels scale with
+ * the square of the resolution scale), drops quickly when over budget and climbs back
+ * slowly, with a dead band in between to avoid oscillating.
+ *
+ * Present() upscales the rectangle to the window with a bilinear fetch plus a light
+ * sharpen whose strength grows as the scale drops.
+ */
+
+// Fullscreen triangle; uv covers the window
+const GLchar* upscaleVertexShaderSource = GLSL(440,
+	out vec2 uv;
+
+void main()
+{
+	vec2 corner = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));
+	uv = corner;
+	gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
+);
+
+// Bilinear upscale of the rendered rectangle with a 4-tap unsharp mask
+const GLchar* upscaleFragmentShaderSource = GLSL(440,
+	in vec2 uv;
+out vec4 fragmentColor;
+
+layout(binding = 6) uniform sampler2D sceneColor;
+uniform vec2 uvScale;		// rendered size / texture size
+uniform float sharpness;
+
+void main()
+{
+	vec2 sourceUv = uv * uvScale;
+	vec2 texel = 1.0 / vec2(textureSize(sceneColor, 0));
+	vec2 maxUv = uvScale - 0.5 * texel;
+
+	vec3 center = texture(sceneColor, sourceUv).rgb;
+	vec3 neighbors = texture(sceneColor, min(sourceUv + vec2(texel.x, 0.0), maxUv)).rgb
+		+ texture(sceneColor, max(sourceUv - vec2(texel.x, 0.0), vec2(0.0))).rgb
+		+ texture(sceneColor, min(sourceUv + vec2(0.0, texel.y), maxUv)).rgb
+		+ texture(sceneColor, max(sourceUv - vec2(0.0, texel.y), vec2(0.0))).rgb;
+
+	vec3 color = center + sharpness * (center - 0.25 * neighbors);
+	fragmentColor = vec4(clamp(color, 0.0, 1.0), 1.0);
+}
+);
+
+
+class DynamicResolution
+{
+public:
+	// Target GPU time per frame and the range the scale may move in
+	float BudgetMs = 1000.0f / 60.0f;
+	float MinScale = 0.5f;
+	float MaxScale = 1.0f;
+	float MaxSharpness = 0.5f;
+
+	bool Initialize(int width, int height)
+	{
+		if (!UCreateShaderProgram(upscaleVertexShaderSource, upscaleFragmentShaderSource, mUpscaleProgramId))
+			return false;
+
+		mUvScaleLoc = glGetUniformLocation(mUpscaleProgramId, "uvScale");
+		mSharpnessLoc = glGetUniformLocation(mUpscaleProgramId, "sharpness");
+
+		glGenFramebuffers(1, &mFbo);
+		glGenVertexArrays(1, &mEmptyVao);
+		glGenQueries(TIMER_SLOTS, mTimers);
+
+		mInitialized = true;
+		return Resize(width, height);
+	}
+
+	void Destroy()
+	{
+		if (!mInitialized)
+			return;
+
+		ReleaseTargets();
+		glDeleteFramebuffers(1, &mFbo);
+		glDeleteVertexArrays(1, &mEmptyVao);
+		glDeleteQueries(TIMER_SLOTS, mTimers);
+		glDeleteProgram(mUpscaleProgramId);
+		mInitialized = false;
+	}
+
+	// (Re)creates the offscreen targets for a window size
+	bool Resize(int width, int height)
+	{
+		if (!mInitialized || width <= 0 || height <= 0 || (width == mWidth && height == mHeight))
+			return true;
+
+		ReleaseTargets();
+		mWidth = width;
+		mHeight = height;
+
+		glGenTextures(1, &mColorTexture);
+		glBindTexture(GL_TEXTURE_2D, mColorTexture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		// Same format as the Hi-Z depth copy so the culler can blit from it
+		glGenTextures(1, &mDepthTexture);
+		glBindTexture(GL_TEXTURE_2D, mDepthTexture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH24_STENCIL8, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, mFbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mColorTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, mDepthTexture, 0);
+		GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		if (status != GL_FRAMEBUFFER_COMPLETE)
+		{
+			ULOG_ERROR("Dynamic resolution framebuffer incomplete: 0x%x", status);
+			return false;
+		}
+
+		UpdateRenderSize();
+		return true;
+	}
+
+	// Picks up finished GPU timings, adjusts the scale, then binds the offscreen target and starts timing
+	void BeginFrame()
+	{
+		CollectTimings();
+
+		glBindFramebuffer(GL_FRAMEBUFFER, mFbo);
+		glViewport(0, 0, mRenderWidth, mRenderHeight);
+
+		// Skip timing this frame if every slot is still waiting for its result
+		mTiming = !mPending[mTimerSlot];
+		if (mTiming)
+			glBeginQuery(GL_TIME_ELAPSED, mTimers[mTimerSlot]);
+	}
+
+	// Upscales the rendered rectangle to the window and closes the frame's GPU timing
+	void Present()
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glViewport(0, 0, mWidth, mHeight);
+		glDisable(GL_DEPTH_TEST);
+
+		glActiveTexture(GL_TEXTURE6);
+		glBindTexture(GL_TEXTURE_2D, mColorTexture);
+		glUseProgram(mUpscaleProgramId);
+		glUniform2f(mUvScaleLoc, (float)mRenderWidth / mWidth, (float)mRenderHeight / mHeight);
+		glUniform1f(mSharpnessLoc, MinScale < MaxScale ? MaxSharpness * (MaxScale - mScale) / (MaxScale - MinScale) : 0.0f);
+		glBindVertexArray(mEmptyVao);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glBindVertexArray(0);
+
+		glEnable(GL_DEPTH_TEST);
+
+		if (mTiming)
+		{
+			glEndQuery(GL_TIME_ELAPSED);
+			mPending[mTimerSlot] = true;
+			mTimerSlot = (mTimerSlot + 1) % TIMER_SLOTS;
+		}
+	}
+
+	// Off: the scale is held at MaxScale
+	void SetEnabled(bool enabled)
+	{
+		mEnabled = enabled;
+		if (!mEnabled)
+		{
+			mScale = MaxScale;
+			UpdateRenderSize();
+		}
+	}
+
+	bool IsEnabled() const { return mEnabled; }
+	float Scale() const { return mScale; }
+	float GpuTimeMs() const { return mGpuTimeMs; }
+
+	// True while the controller is still moving the scale, so idle rendering can let it converge
+	bool IsSettling() const { return mSettling; }
+
+	GLuint Fbo() const { return mFbo; }
+	int RenderWidth() const { return mRenderWidth; }
+	int RenderHeight() const { return mRenderHeight; }
+
+private:
+	static const int TIMER_SLOTS = 4;
+
+	// Reads every finished timer in submission order without waiting and feeds the controller
+	void CollectTimings()
+	{
+		mSettling = false;
+		for (int i = 0; i < TIMER_SLOTS; ++i)
+		{
+			int slot = (mTimerSlot + i) % TIMER_SLOTS;
+			if (!mPending[slot])
+				continue;
+
+			GLint available = 0;
+			glGetQueryObjectiv(mTimers[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				break;
+
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(mTimers[slot], GL_QUERY_RESULT, &elapsed);
+			mPending[slot] = false;
+			Update((float)(elapsed / 1.0e6));
+		}
+	}
+
+	void Update(float gpuTimeMs)
+	{
+		// Smooth single-frame spikes out, but let a sustained overload through within a few frames
+		mGpuTimeMs = mGpuTimeMs > 0.0f ? mGpuTimeMs + 0.3f * (gpuTimeMs - mGpuTimeMs) : gpuTimeMs;
+		if (!mEnabled)
+			return;
+
+		float target = mScale;
+		if (mGpuTimeMs > BudgetMs)
+			target = mScale * std::sqrt(BudgetMs / mGpuTimeMs);						// over budget: drop now
+		else if (mGpuTimeMs < 0.8f * BudgetMs)
+			target = std::min(mScale * std::sqrt(0.9f * BudgetMs / mGpuTimeMs), mScale + 0.02f);	// headroom: climb slowly
+
+		target = std::max(MinScale, std::min(MaxScale, target));
+		if (std::fabs(target - mScale) > 0.001f)
+		{
+			mScale = target;
+			mSettling = true;
+			UpdateRenderSize();
+		}
+	}
+
+	void UpdateRenderSize()
+	{
+		mRenderWidth = std::max(1, (int)(mWidth * mScale + 0.5f));
+		mRenderHeight = std::max(1, (int)(mHeight * mScale + 0.5f));
+	}
+
+	void ReleaseTargets()
+	{
+		if (mColorTexture)
+			glDeleteTextures(1, &mColorTexture);
+		if (mDepthTexture)
+			glDeleteTextures(1, &mDepthTexture);
+		mColorTexture = 0;
+		mDepthTexture = 0;
+	}
+
+	bool mInitialized = false;
+	bool mEnabled = true;
+	bool mSettling = false;
+	float mScale = 1.0f;
+	float mGpuTimeMs = 0.0f;
+
+	int mWidth = 0;
+	int mHeight = 0;
+	int mRenderWidth = 0;
+	int mRenderHeight = 0;
+
+	GLuint mFbo = 0;
+	GLuint mColorTexture = 0;
+	GLuint mDepthTexture = 0;
+	GLuint mEmptyVao = 0;
+
+	GLuint mUpscaleProgramId = 0;
+	GLint mUvScaleLoc = -1;
+	GLint mSharpnessLoc = -1;
+
+	GLuint mTimers[TIMER_SLOTS] = {};
+	bool mPending[TIMER_SLOTS] = {};
+	int mTimerSlot = 0;
+	bool mTiming = false;
+};
+
+#endif // DYNAMICRESOLUTION_H
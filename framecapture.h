@@ -0,0 +1,383 @@
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#include <GL/glew.h>        // GLEW library
+#include <stb_image_write.h>  // PNG encoding (implementation compiled in Source.cpp)
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "log.h"
+
+/* Frame capture
+ * -------------
+ * Records the window's frames without stalling the render loop. Capture() queues a
+ * glReadPixels of the back buffer into one slot of a ring of pixel pack buffers, followed
+ * by a fence. The call returns as soon as the copy is queued. Each buffer is mapped once,
+ * persistently and coherently, when recording starts. A later Capture() hands every slot
+ * whose fence has signalled to the encoder threads, usually two or three frames on.
+ *
+ * An encoder reads the pixels straight from the mapping. It converts them into a buffer of
+ * its own and frees the slot before the slow part (compression and file I/O) begins. The
+ * output is either a numbered PNG per frame, encoded on several threads, or one YUV4MPEG2
+ * stream (4:2:0, full-range BT.601, flagged XCOLORRANGE=FULL since decoders assume limited
+ * range otherwise) written by a single thread so frames stay in order.
+ *
+ * When the encoders fall a whole ring behind, a frame is skipped and counted rather than
+ * waited for. Frames of a different size than the first one are skipped too, because a
+ * Y4M stream has one size. Stop() drains the frames still queued and reports both counts.
+ */
+class FrameCapture
+{
+public:
+	enum Format
+	{
+		CAPTURE_PNG,
+		CAPTURE_Y4M
+	};
+
+	static const int RING_SIZE = 4;
+
+	// Frame rate written into the Y4M header
+	int FramesPerSecond = 60;
+
+	// PNG encoder threads; 0 picks half the hardware threads
+	int PngEncoders = 0;
+
+	// zlib level for PNG, traded for encoding speed
+	int PngCompression = 2;
+
+	bool Recording() const { return mRecording; }
+
+	// Starts a take named after the first unused <prefix>_NNN in the working directory
+	bool Start(const char* prefix, Format format, int width, int height)
+	{
+		if (mRecording)
+			return true;
+
+		mFormat = format;
+		mWidth = width;
+		mHeight = height;
+		mBasePath = FreeTakePath(prefix, format);
+		mFramesQueued = 0;
+		mFramesSkipped = 0;
+		mFramesFailed = 0;
+		mWarnedSize = false;
+		mNext = 0;
+
+		GLsizeiptr size = (GLsizeiptr)width * height * 4;
+		const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		for (Slot& slot : mSlots)
+		{
+			glGenBuffers(1, &slot.buffer);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+			glBufferStorage(GL_PIXEL_PACK_BUFFER, size, nullptr, flags);
+			slot.mapped = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, flags);
+			slot.busy.store(false, std::memory_order_relaxed);
+			if (!slot.mapped)
+			{
+				ULOG_ERROR("Failed to map a %dx%d frame capture buffer", width, height);
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+				ReleaseBuffers();
+				return false;
+			}
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		int encoders = 1;
+		if (format == CAPTURE_Y4M)
+		{
+			std::string path = mBasePath + ".y4m";
+			mFile = fopen(path.c_str(), "wb");
+			if (!mFile)
+			{
+				ULOG_ERROR("Failed to create %s", path.c_str());
+				ReleaseBuffers();
+				return false;
+			}
+			fprintf(mFile, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n", width, height, FramesPerSecond);
+		}
+		else
+		{
+			stbi_write_png_compression_level = PngCompression;
+			encoders = PngEncoders > 0 ? PngEncoders : std::max(1, (int)std::thread::hardware_concurrency() / 2);
+		}
+
+		mQuit = false;
+		for (int i = 0; i < encoders; ++i)
+			mEncoders.emplace_back(&FrameCapture::Encode, this);
+
+		mRecording = true;
+		ULOG_INFO("Recording %dx%d to %s%s", width, height, mBasePath.c_str(), format == CAPTURE_Y4M ? ".y4m" : "_*.png");
+		return true;
+	}
+
+	// Render thread, once the frame is complete in the back buffer: queues its readback and hands finished ones on
+	void Capture(int width, int height)
+	{
+		if (!mRecording)
+			return;
+
+		Collect(false);
+
+		if (width != mWidth || height != mHeight)
+		{
+			++mFramesSkipped;
+			if (!mWarnedSize)
+				ULOG_WARNING("Frame capture: window is %dx%d, recording %dx%d; skipping frames until it matches", width, height, mWidth, mHeight);
+			mWarnedSize = true;
+			return;
+		}
+
+		// The encoders are a whole ring behind: skip rather than stall
+		Slot& slot = mSlots[mNext];
+		if (slot.busy.load(std::memory_order_acquire))
+		{
+			++mFramesSkipped;
+			return;
+		}
+
+		slot.busy.store(true, std::memory_order_relaxed);
+		slot.frame = mFramesQueued++;
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		mPending.push_back(mNext);
+		mNext = (mNext + 1) % RING_SIZE;
+	}
+
+	// Waits for the queued frames to be written and ends the take
+	void Stop()
+	{
+		if (!mRecording)
+			return;
+
+		Collect(true);
+		{
+			std::lock_guard<std::mutex> lock(mJobMutex);
+			mQuit = true;
+		}
+		mJobReady.notify_all();
+		for (std::thread& encoder : mEncoders)
+			encoder.join();
+		mEncoders.clear();
+
+		if (mFile)
+		{
+			fclose(mFile);
+			mFile = nullptr;
+		}
+		ReleaseBuffers();
+		mRecording = false;
+
+		ULOG_INFO("Recording stopped: %u frames to %s%s, %u skipped, %u failed to write", mFramesQueued, mBasePath.c_str(),
+			mFormat == CAPTURE_Y4M ? ".y4m" : "_*.png", mFramesSkipped, mFramesFailed.load());
+	}
+
+	void Destroy() { Stop(); }
+
+private:
+	struct Slot
+	{
+		GLuint buffer = 0;
+		const unsigned char* mapped = nullptr;	// RGBA, bottom row first
+		GLsync fence = 0;
+		unsigned frame = 0;
+		std::atomic<bool> busy{ false };		// from the readback until an encoder has converted the pixels
+	};
+
+	static bool FileExists(const std::string& path)
+	{
+		FILE* file = fopen(path.c_str(), "rb");
+		if (file)
+			fclose(file);
+		return file != nullptr;
+	}
+
+	static std::string FreeTakePath(const char* prefix, Format format)
+	{
+		char base[256];
+		for (int take = 1;; ++take)
+		{
+			snprintf(base, sizeof(base), "%s_%03d", prefix, take);
+			if (!FileExists(std::string(base) + (format == CAPTURE_Y4M ? ".y4m" : "_000000.png")))
+				return base;
+		}
+	}
+
+	// Render thread: hands the slots whose readback has completed to the encoders, in capture order
+	void Collect(bool wait)
+	{
+		while (!mPending.empty())
+		{
+			Slot& slot = mSlots[mPending.front()];
+			GLenum result = glClientWaitSync(slot.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000 : 0);	// 1 ms
+			if (result == GL_TIMEOUT_EXPIRED)
+			{
+				if (wait)
+					continue;
+				return;
+			}
+
+			glDeleteSync(slot.fence);
+			slot.fence = 0;
+			if (result == GL_WAIT_FAILED)
+			{
+				++mFramesFailed;
+				slot.busy.store(false, std::memory_order_release);
+			}
+			else
+			{
+				std::lock_guard<std::mutex> lock(mJobMutex);
+				mJobs.push_back(mPending.front());
+			}
+			mJobReady.notify_one();
+			mPending.pop_front();
+		}
+	}
+
+	// Encoder thread: converts each handed-over slot, frees it, then compresses and writes the frame
+	void Encode()
+	{
+		std::vector<unsigned char> pixels;
+		for (;;)
+		{
+			int index;
+			{
+				std::unique_lock<std::mutex> lock(mJobMutex);
+				mJobReady.wait(lock, [this] { return !mJobs.empty() || mQuit; });
+				if (mJobs.empty())
+					return;
+				index = mJobs.front();
+				mJobs.pop_front();
+			}
+
+			Slot& slot = mSlots[index];
+			unsigned frame = slot.frame;
+			if (mFormat == CAPTURE_Y4M)
+			{
+				ToYuv420(slot.mapped, pixels);
+				slot.busy.store(false, std::memory_order_release);
+				if (fwrite("FRAME\n", 1, 6, mFile) != 6 || fwrite(pixels.data(), 1, pixels.size(), mFile) != pixels.size())
+					++mFramesFailed;
+			}
+			else
+			{
+				ToRgb(slot.mapped, pixels);
+				slot.busy.store(false, std::memory_order_release);
+				char path[300];
+				snprintf(path, sizeof(path), "%s_%06u.png", mBasePath.c_str(), frame);
+				if (!stbi_write_png(path, mWidth, mHeight, 3, pixels.data(), mWidth * 3))
+					++mFramesFailed;
+			}
+		}
+	}
+
+	// Top row first, alpha dropped (the window's alpha is not meaningful)
+	void ToRgb(const unsigned char* rgba, std::vector<unsigned char>& rgb) const
+	{
+		rgb.resize((size_t)mWidth * mHeight * 3);
+		for (int y = 0; y < mHeight; ++y)
+		{
+			const unsigned char* source = rgba + (size_t)(mHeight - 1 - y) * mWidth * 4;
+			unsigned char* target = rgb.data() + (size_t)y * mWidth * 3;
+			for (int x = 0; x < mWidth; ++x, source += 4, target += 3)
+			{
+				target[0] = source[0];
+				target[1] = source[1];
+				target[2] = source[2];
+			}
+		}
+	}
+
+	// Planar Y, Cb, Cr with chroma averaged over 2x2 blocks, top row first; fixed-point full-range BT.601
+	void ToYuv420(const unsigned char* rgba, std::vector<unsigned char>& yuv) const
+	{
+		int chromaWidth = (mWidth + 1) / 2;
+		int chromaHeight = (mHeight + 1) / 2;
+		yuv.resize((size_t)mWidth * mHeight + 2 * (size_t)chromaWidth * chromaHeight);
+		unsigned char* luma = yuv.data();
+		unsigned char* cb = luma + (size_t)mWidth * mHeight;
+		unsigned char* cr = cb + (size_t)chromaWidth * chromaHeight;
+
+		for (int y = 0; y < mHeight; ++y)
+		{
+			const unsigned char* source = rgba + (size_t)(mHeight - 1 - y) * mWidth * 4;
+			unsigned char* target = luma + (size_t)y * mWidth;
+			for (int x = 0; x < mWidth; ++x, source += 4)
+				target[x] = (unsigned char)((77 * source[0] + 150 * source[1] + 29 * source[2] + 128) >> 8);
+		}
+
+		for (int cy = 0; cy < chromaHeight; ++cy)
+		{
+			int row0 = mHeight - 1 - 2 * cy;
+			int row1 = std::max(row0 - 1, 0);
+			for (int cx = 0; cx < chromaWidth; ++cx)
+			{
+				int x0 = 2 * cx;
+				int x1 = std::min(x0 + 1, mWidth - 1);
+				const unsigned char* p[4] = {
+					rgba + ((size_t)row0 * mWidth + x0) * 4, rgba + ((size_t)row0 * mWidth + x1) * 4,
+					rgba + ((size_t)row1 * mWidth + x0) * 4, rgba + ((size_t)row1 * mWidth + x1) * 4 };
+				int r = (p[0][0] + p[1][0] + p[2][0] + p[3][0] + 2) >> 2;
+				int g = (p[0][1] + p[1][1] + p[2][1] + p[3][1] + 2) >> 2;
+				int b = (p[0][2] + p[1][2] + p[2][2] + p[3][2] + 2) >> 2;
+				size_t index = (size_t)cy * chromaWidth + cx;
+				cb[index] = (unsigned char)std::min((-43 * r - 85 * g + 128 * b + 32896) >> 8, 255);
+				cr[index] = (unsigned char)std::min((128 * r - 107 * g - 21 * b + 32896) >> 8, 255);
+			}
+		}
+	}
+
+	void ReleaseBuffers()
+	{
+		for (Slot& slot : mSlots)
+		{
+			if (slot.fence)
+				glDeleteSync(slot.fence);
+			if (slot.buffer && slot.mapped)
+			{
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+				glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			}
+			if (slot.buffer)
+				glDeleteBuffers(1, &slot.buffer);
+			slot.buffer = 0;
+			slot.mapped = nullptr;
+			slot.fence = 0;
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		mPending.clear();
+	}
+
+	Slot mSlots[RING_SIZE];
+	std::deque<int> mPending;				// render thread: slots with a readback in flight, oldest first
+	int mNext = 0;							// render thread: slot the next frame is read into
+	bool mRecording = false;
+	Format mFormat = CAPTURE_PNG;
+	int mWidth = 0;
+	int mHeight = 0;
+	std::string mBasePath;
+	FILE* mFile = nullptr;					// Y4M stream, written by the single encoder
+	unsigned mFramesQueued = 0;
+	unsigned mFramesSkipped = 0;
+	std::atomic<unsigned> mFramesFailed{ 0 };
+	bool mWarnedSize = false;
+
+	std::vector<std::thread> mEncoders;
+	std::mutex mJobMutex;
+	std::condition_variable mJobReady;
+	std::deque<int> mJobs;					// guarded by mJobMutex: slots ready to encode
+	bool mQuit = false;						// guarded by mJobMutex
+};
+
+#endif // FRAMECAPTURE_H
@@ -0,0 +1,191 @@
+#ifndef FRAMEPACING_H
+#define FRAMEPACING_H
+
+#include <GL/glew.h>        // GLEW library
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <mmsystem.h>       // timeBeginPeriod
+#pragma comment(lib, "winmm.lib")
+#endif
+
+/* Frame pacing
+ * ------------
+ * Controls when the render loop may start a frame, and measures how long input takes to
+ * reach the screen.
+ *
+ * Queue depth: a fence goes in after every swap. Before a frame starts, WaitForFrame blocks
+ * until no more than MaxFramesInFlight - 1 earlier frames are still queued on the GPU.
+ * Without this the driver lets the CPU run several frames ahead, and each of those frames
+ * adds a frame of latency between sampling input and showing it.
+ *
+ * Frame limiter: frames start on a fixed schedule of 1 / FrameRateLimit seconds. The wait
+ * sleeps until SpinSeconds before the deadline, then spins, so an OS sleep that is late by
+ * a scheduler tick does not make the frame late. On Windows the timer resolution is raised
+ * to 1 ms while the pacer is in use. A frame that starts more than a period late restarts
+ * the schedule instead of rushing the following frames to catch up.
+ *
+ * Latency: the caller passes each frame the time the oldest input it shows for the first
+ * time was sampled. A GL_TIMESTAMP query issued after the swap records when the GPU
+ * reached the present. It is converted to the CPU clock through a GPU/CPU time pair taken
+ * at submission, and the difference is the input-to-present latency. Scan-out, at most one
+ * refresh interval with vsync, comes on top.
+ */
+class FramePacer
+{
+public:
+	// Frames the GPU may have queued when a new one starts; 0 leaves it to the driver
+	int MaxFramesInFlight = 0;
+
+	// Frames per second the loop may start; 0 for no limit
+	double FrameRateLimit = 0.0;
+
+	// Final part of a limiter wait spent spinning instead of sleeping
+	double SpinSeconds = 0.002;
+
+	// Seconds on a steady clock; input timestamps passed to EndFrame must use this clock
+	static double Now()
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void Initialize()
+	{
+#ifdef _WIN32
+		timeBeginPeriod(1);
+#endif
+	}
+
+	void Destroy()
+	{
+		for (const Frame& frame : mFrames)
+		{
+			glDeleteSync(frame.fence);
+			glDeleteQueries(1, &frame.presentQuery);
+		}
+		mFrames.clear();
+#ifdef _WIN32
+		timeEndPeriod(1);
+#endif
+	}
+
+	// Call before sampling the input of a frame: drains the GPU queue to its depth, then waits for the frame's slot
+	void WaitForFrame()
+	{
+		Retire(false);
+		while (MaxFramesInFlight > 0 && (int)mFrames.size() >= MaxFramesInFlight)
+			Retire(true);
+
+		if (FrameRateLimit <= 0.0)
+		{
+			mNextFrame = 0.0;
+			return;
+		}
+
+		double period = 1.0 / FrameRateLimit;
+		double now = Now();
+		if (mNextFrame == 0.0 || now - mNextFrame > period)
+			mNextFrame = now;
+
+		double remaining = mNextFrame - now;
+		if (remaining > SpinSeconds)
+			std::this_thread::sleep_for(std::chrono::duration<double>(remaining - SpinSeconds));
+		while (Now() < mNextFrame)
+			std::this_thread::yield();
+		mNextFrame += period;
+	}
+
+	// Call right after the swap; inputTime is the Now() of the oldest input the frame shows first, negative for none
+	void EndFrame(double inputTime)
+	{
+		Frame frame;
+		frame.inputTime = inputTime;
+		glGenQueries(1, &frame.presentQuery);
+		glQueryCounter(frame.presentQuery, GL_TIMESTAMP);
+		frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+		// GPU and CPU clocks at the same moment, to place the present on the CPU clock later
+		GLint64 gpuNow = 0;
+		glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+		frame.clockOffset = Now() - gpuNow * 1.0e-9;
+		mFrames.push_back(frame);
+	}
+
+	// Input-to-present latency over the samples since the last call; false when there were none
+	bool TakeLatency(double& averageMs, double& worstMs, int& samples)
+	{
+		samples = mLatencySamples;
+		if (samples == 0)
+			return false;
+
+		averageMs = mLatencySum / samples * 1000.0;
+		worstMs = mLatencyWorst * 1000.0;
+		mLatencySum = 0.0;
+		mLatencyWorst = 0.0;
+		mLatencySamples = 0;
+		return true;
+	}
+
+private:
+	struct Frame
+	{
+		GLsync fence = 0;
+		GLuint presentQuery = 0;
+		double inputTime = -1.0;
+		double clockOffset = 0.0;			// CPU seconds minus GPU seconds at submission
+	};
+
+	// Retires the oldest frame once its fence has signalled; with wait, blocks until it has
+	void Retire(bool wait)
+	{
+		while (!mFrames.empty())
+		{
+			Frame& frame = mFrames.front();
+			GLenum result = glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? 1000000000ull : 0);	// 1 s
+			if (result == GL_TIMEOUT_EXPIRED)
+			{
+				if (wait)
+					continue;
+				return;
+			}
+
+			if (result != GL_WAIT_FAILED && frame.inputTime >= 0.0)
+			{
+				GLuint64 presentTime = 0;
+				glGetQueryObjectui64v(frame.presentQuery, GL_QUERY_RESULT, &presentTime);
+				double latency = presentTime * 1.0e-9 + frame.clockOffset - frame.inputTime;
+				if (latency >= 0.0)
+				{
+					mLatencySum += latency;
+					mLatencyWorst = std::max(mLatencyWorst, latency);
+					++mLatencySamples;
+				}
+			}
+
+			glDeleteSync(frame.fence);
+			glDeleteQueries(1, &frame.presentQuery);
+			mFrames.pop_front();
+			if (wait)
+				return;
+		}
+	}
+
+	std::deque<Frame> mFrames;				// submitted, oldest first
+	double mNextFrame = 0.0;				// limiter deadline of the next frame
+	double mLatencySum = 0.0;
+	double mLatencyWorst = 0.0;
+	int mLatencySamples = 0;
+};
+
+#endif // FRAMEPACING_H
@@ -0,0 +1,520 @@
+#ifndef GLTRACE_H
+#define GLTRACE_H
+
+#include <GL/glew.h>        // GLEW library
+
+#include <fstream>          // ofstream
+#include "log.h"            // ULOG_*
+#include <sstream>          // ostringstream
+#include <string>
+#include <vector>
+
+/* GL call tracing
+ * ---------------
+ * Optional instrumentation layer that wraps every GL entry point used in Source.cpp and
+ * the headers it includes after this one; a new GL call needs a wrapper here, or the
+ * counters and captures silently miss it. Build with GL_TRACE defined to route every
+ * wrapped call through GLTrace, which counts calls by category for each frame and can
+ * capture a full frame (call list with arguments) to a text file. Without GL_TRACE the
+ * GL names are left untouched and the counters simply stay at zero.
+ */
+
+enum GLTraceCategory
+{
+	GLTRACE_DRAW,		// draws, blits, readbacks, dispatches and clears
+	GLTRACE_STATE,		// binds, enables, program and texture state changes
+	GLTRACE_UNIFORM,	// uniform uploads
+	GLTRACE_RESOURCE,	// object creation, uploads and deletion
+	GLTRACE_QUERY,		// queries, fences and glGet* round trips
+	GLTRACE_CATEGORY_COUNT
+};
+
+struct GLTraceCounters
+{
+	unsigned int Calls[GLTRACE_CATEGORY_COUNT] = {};
+	unsigned int Total = 0;
+};
+
+class GLTrace
+{
+public:
+	// Counters of the last completed frame
+	GLTraceCounters LastFrame;
+
+	// Records a single call in the current frame
+	void Record(GLTraceCategory category)
+	{
+		++mCurrent.Calls[category];
+		++mCurrent.Total;
+	}
+
+	// True while the current frame is being captured, so callers only format arguments when needed
+	bool IsCapturing() const { return mCapturing; }
+
+	void CaptureCall(GLTraceCategory category, const char* name, const std::string& args)
+	{
+		std::ostringstream line;
+		line << CategoryName(category) << "\t" << name << "(" << args << ")";
+		mCaptureLog.push_back(line.str());
+	}
+
+	// Requests a capture of the next full frame, written to filename when that frame ends
+	void RequestCapture(const char* filename)
+	{
+		mCaptureFile = filename;
+		mCaptureRequested = true;
+	}
+
+	// Closes the current frame: publishes its counters and finishes or starts a capture
+	void EndFrame()
+	{
+		LastFrame = mCurrent;
+		mCurrent = GLTraceCounters();
+
+		if (mCapturing)
+		{
+			WriteCapture();
+			mCapturing = false;
+			mCaptureLog.clear();
+		}
+		if (mCaptureRequested)
+		{
+			mCaptureRequested = false;
+			mCapturing = true;
+		}
+	}
+
+	void PrintLastFrame() const
+	{
+		std::ostringstream line;
+		line << "GL calls last frame: " << LastFrame.Total;
+		for (int i = 0; i < GLTRACE_CATEGORY_COUNT; ++i)
+			line << "  " << CategoryName(GLTraceCategory(i)) << "=" << LastFrame.Calls[i];
+		ULOG_INFO("%s", line.str().c_str());
+	}
+
+	static const char* CategoryName(GLTraceCategory category)
+	{
+		static const char* const names[GLTRACE_CATEGORY_COUNT] = { "draw", "state", "uniform", "resource", "query" };
+		return names[category];
+	}
+
+private:
+	void WriteCapture() const
+	{
+		std::ofstream out(mCaptureFile);
+		if (!out)
+		{
+			ULOG_ERROR("Failed to write GL frame capture %s", mCaptureFile.c_str());
+			return;
+		}
+		for (const std::string& line : mCaptureLog)
+			out << line << "\n";
+		ULOG_INFO("GL frame capture (%u calls) written to %s", (unsigned)mCaptureLog.size(), mCaptureFile.c_str());
+	}
+
+	GLTraceCounters mCurrent;
+	std::vector<std::string> mCaptureLog;
+	std::string mCaptureFile;
+	bool mCaptureRequested = false;
+	bool mCapturing = false;
+};
+
+inline GLTrace& UGLTrace()
+{
+	static GLTrace trace;
+	return trace;
+}
+
+// Argument formatting for frame captures
+template <typename T>
+inline void UTraceFormatArg(std::ostream& os, const T& value) { os << value; }
+inline void UTraceFormatArg(std::ostream& os, const GLchar* str) { if (str) os << '"' << str << '"'; else os << "NULL"; }
+inline void UTraceFormatArg(std::ostream& os, GLchar* buffer) { os << static_cast<const void*>(buffer); } // output buffers are not initialized yet
+
+inline void UTraceFormatArgList(std::ostream&) {}
+
+template <typename First, typename... Rest>
+inline void UTraceFormatArgList(std::ostream& os, const First& first, const Rest&... rest)
+{
+	os << ", ";
+	UTraceFormatArg(os, first);
+	UTraceFormatArgList(os, rest...);
+}
+
+inline std::string UTraceFormatArgs() { return std::string(); }
+
+template <typename First, typename... Rest>
+inline std::string UTraceFormatArgs(const First& first, const Rest&... rest)
+{
+	std::ostringstream os;
+	UTraceFormatArg(os, first);
+	UTraceFormatArgList(os, rest...);
+	return os.str();
+}
+
+#ifdef GL_TRACE
+
+// Defines UTrace_<name> which records the call and forwards it to the real entry point
+#define GLTRACE_WRAP_VOID(Category, Name, Params, Args) \
+	inline void UTrace_##Name Params \
+	{ \
+		UGLTrace().Record(Category); \
+		if (UGLTrace().IsCapturing()) UGLTrace().CaptureCall(Category, #Name, UTraceFormatArgs Args); \
+		Name Args; \
+	}
+
+#define GLTRACE_WRAP_RET(Category, Ret, Name, Params, Args) \
+	inline Ret UTrace_##Name Params \
+	{ \
+		UGLTrace().Record(Category); \
+		if (UGLTrace().IsCapturing()) UGLTrace().CaptureCall(Category, #Name, UTraceFormatArgs Args); \
+		return Name Args; \
+	}
+
+// Draws
+GLTRACE_WRAP_VOID(GLTRACE_DRAW, glClear, (GLbitfield mask), (mask))
+GLTRACE_WRAP_VOID(GLTRACE_DRAW, glDrawArrays, (GLenum mode, GLint first, GLsizei count), (mode, first, count))
+GLTRACE_WRAP_VOID(GLTRACE_DRAW, glDrawElements, (GLenum mode, GLsizei count, GLenum type, const void* indices), (mode, count, type, indices))
+GLTRACE_WRAP_VOID(GLTRACE_DRAW, glBlitFramebuffer, (GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter), (srcX0, srcY0, srcX1, srcY1, dstX0, dstY0, dstX1, dstY1, mask, filter))
+GLTRACE_WRAP_VOID(GLTRACE_DRAW, glReadPixels, (GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void* pixels), (x, y, width, height, format, type, pixels))
+GLTRACE_WRAP_VOID(GLTRACE_DRAW, glDispatchCompute, (GLuint numGroupsX, GLuint numGroupsY, GLuint numGroupsZ), (numGroupsX, numGroupsY, numGroupsZ))
+GLTRACE_WRAP_VOID(GLTRACE_DRAW, glDrawElementsInstancedBaseInstance, (GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instancecount, GLuint baseinstance), (mode, count, type, indices, instancecount, baseinstance))
+GLTRACE_WRAP_VOID(GLTRACE_DRAW, glDrawArraysInstancedBaseInstance, (GLenum mode, GLint first, GLsizei count, GLsizei instancecount, GLuint baseinstance), (mode, first, count, instancecount, baseinstance))
+GLTRACE_WRAP_VOID(GLTRACE_DRAW, glMultiDrawElementsIndirect, (GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride), (mode, type, indirect, drawcount, stride))
+GLTRACE_WRAP_VOID(GLTRACE_DRAW, glMultiDrawArraysIndirect, (GLenum mode, const void* indirect, GLsizei drawcount, GLsizei stride), (mode, indirect, drawcount, stride))
+GLTRACE_WRAP_VOID(GLTRACE_DRAW, glMultiDrawElementsIndirectCount, (GLenum mode, GLenum type, const void* indirect, GLintptr drawcount, GLsizei maxdrawcount, GLsizei stride), (mode, type, indirect, drawcount, maxdrawcount, stride))
+GLTRACE_WRAP_VOID(GLTRACE_DRAW, glMultiDrawArraysIndirectCount, (GLenum mode, const void* indirect, GLintptr drawcount, GLsizei maxdrawcount, GLsizei stride), (mode, indirect, drawcount, maxdrawcount, stride))
+GLTRACE_WRAP_VOID(GLTRACE_DRAW, glMultiDrawElementsIndirectCountARB, (GLenum mode, GLenum type, const void* indirect, GLintptr drawcount, GLsizei maxdrawcount, GLsizei stride), (mode, type, indirect, drawcount, maxdrawcount, stride))
+GLTRACE_WRAP_VOID(GLTRACE_DRAW, glMultiDrawArraysIndirectCountARB, (GLenum mode, const void* indirect, GLintptr drawcount, GLsizei maxdrawcount, GLsizei stride), (mode, indirect, drawcount, maxdrawcount, stride))
+GLTRACE_WRAP_VOID(GLTRACE_DRAW, glClearBufferData, (GLenum target, GLenum internalformat, GLenum format, GLenum type, const void* data), (target, internalformat, format, type, data))
+
+// State changes
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glEnable, (GLenum cap), (cap))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glDisable, (GLenum cap), (cap))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glDepthFunc, (GLenum func), (func))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glDepthMask, (GLboolean flag), (flag))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glColorMask, (GLboolean r, GLboolean g, GLboolean b, GLboolean a), (r, g, b, a))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glClearColor, (GLfloat r, GLfloat g, GLfloat b, GLfloat a), (r, g, b, a))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glViewport, (GLint x, GLint y, GLsizei width, GLsizei height), (x, y, width, height))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glUseProgram, (GLuint program), (program))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glBindVertexArray, (GLuint array), (array))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glEnableVertexAttribArray, (GLuint index), (index))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glVertexAttribPointer, (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer), (index, size, type, normalized, stride, pointer))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glVertexAttribIPointer, (GLuint index, GLint size, GLenum type, GLsizei stride, const void* pointer), (index, size, type, stride, pointer))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glVertexAttribDivisor, (GLuint index, GLuint divisor), (index, divisor))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glActiveTexture, (GLenum texture), (texture))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glBindTexture, (GLenum target, GLuint texture), (target, texture))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glTexParameteri, (GLenum target, GLenum pname, GLint param), (target, pname, param))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glTexParameterfv, (GLenum target, GLenum pname, const GLfloat* params), (target, pname, params))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glBindFramebuffer, (GLenum target, GLuint framebuffer), (target, framebuffer))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glFramebufferTexture2D, (GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level), (target, attachment, textarget, texture, level))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glBindImageTexture, (GLuint unit, GLuint texture, GLint level, GLboolean layered, GLint layer, GLenum access, GLenum format), (unit, texture, level, layered, layer, access, format))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glMemoryBarrier, (GLbitfield barriers), (barriers))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glBindBuffer, (GLenum target, GLuint buffer), (target, buffer))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glBindBufferBase, (GLenum target, GLuint index, GLuint buffer), (target, index, buffer))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glBeginConditionalRender, (GLuint id, GLenum mode), (id, mode))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glEndConditionalRender, (), ())
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glBindBufferRange, (GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size), (target, index, buffer, offset, size))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glBindSampler, (GLuint unit, GLuint sampler), (unit, sampler))
+GLTRACE_WRAP_VOID(GLTRACE_STATE, glPixelStorei, (GLenum pname, GLint param), (pname, param))
+
+// Uniform uploads
+GLTRACE_WRAP_VOID(GLTRACE_UNIFORM, glUniform1i, (GLint location, GLint v0), (location, v0))
+GLTRACE_WRAP_VOID(GLTRACE_UNIFORM, glUniform1f, (GLint location, GLfloat v0), (location, v0))
+GLTRACE_WRAP_VOID(GLTRACE_UNIFORM, glUniform2fv, (GLint location, GLsizei count, const GLfloat* value), (location, count, value))
+GLTRACE_WRAP_VOID(GLTRACE_UNIFORM, glUniform3fv, (GLint location, GLsizei count, const GLfloat* value), (location, count, value))
+GLTRACE_WRAP_VOID(GLTRACE_UNIFORM, glUniform4fv, (GLint location, GLsizei count, const GLfloat* value), (location, count, value))
+GLTRACE_WRAP_VOID(GLTRACE_UNIFORM, glUniform3f, (GLint location, GLfloat v0, GLfloat v1, GLfloat v2), (location, v0, v1, v2))
+GLTRACE_WRAP_VOID(GLTRACE_UNIFORM, glUniformMatrix4fv, (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value), (location, count, transpose, value))
+GLTRACE_WRAP_VOID(GLTRACE_UNIFORM, glProgramUniform4f, (GLuint program, GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3), (program, location, v0, v1, v2, v3))
+GLTRACE_WRAP_VOID(GLTRACE_UNIFORM, glUniform1ui, (GLint location, GLuint v0), (location, v0))
+GLTRACE_WRAP_VOID(GLTRACE_UNIFORM, glProgramUniformMatrix4fv, (GLuint program, GLint location, GLsizei count, GLboolean transpose, const GLfloat* value), (program, location, count, transpose, value))
+GLTRACE_WRAP_VOID(GLTRACE_UNIFORM, glProgramUniform2fv, (GLuint program, GLint location, GLsizei count, const GLfloat* value), (program, location, count, value))
+GLTRACE_WRAP_VOID(GLTRACE_UNIFORM, glUniform2f, (GLint location, GLfloat v0, GLfloat v1), (location, v0, v1))
+
+// Resources
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glGenTextures, (GLsizei n, GLuint* textures), (n, textures))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glDeleteTextures, (GLsizei n, const GLuint* textures), (n, textures))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glTexImage2D, (GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* pixels), (target, level, internalformat, width, height, border, format, type, pixels))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glGenerateMipmap, (GLenum target), (target))
+GLTRACE_WRAP_RET(GLTRACE_RESOURCE, GLuint, glCreateProgram, (), ())
+GLTRACE_WRAP_RET(GLTRACE_RESOURCE, GLuint, glCreateShader, (GLenum type), (type))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glShaderSource, (GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length), (shader, count, string, length))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glCompileShader, (GLuint shader), (shader))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glAttachShader, (GLuint program, GLuint shader), (program, shader))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glLinkProgram, (GLuint program), (program))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glDeleteProgram, (GLuint program), (program))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glBufferData, (GLenum target, GLsizeiptr size, const void* data, GLenum usage), (target, size, data, usage))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glDeleteShader, (GLuint shader), (shader))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glGenBuffers, (GLsizei n, GLuint* buffers), (n, buffers))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glDeleteBuffers, (GLsizei n, const GLuint* buffers), (n, buffers))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glBufferSubData, (GLenum target, GLintptr offset, GLsizeiptr size, const void* data), (target, offset, size, data))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glBufferStorage, (GLenum target, GLsizeiptr size, const void* data, GLbitfield flags), (target, size, data, flags))
+GLTRACE_WRAP_RET(GLTRACE_RESOURCE, void*, glMapBufferRange, (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access), (target, offset, length, access))
+GLTRACE_WRAP_RET(GLTRACE_RESOURCE, GLboolean, glUnmapBuffer, (GLenum target), (target))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glGenSamplers, (GLsizei count, GLuint* samplers), (count, samplers))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glDeleteSamplers, (GLsizei count, const GLuint* samplers), (count, samplers))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glSamplerParameteri, (GLuint sampler, GLenum pname, GLint param), (sampler, pname, param))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glSamplerParameterf, (GLuint sampler, GLenum pname, GLfloat param), (sampler, pname, param))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glSamplerParameterfv, (GLuint sampler, GLenum pname, const GLfloat* param), (sampler, pname, param))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glTexStorage2D, (GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height), (target, levels, internalformat, width, height))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glTexSubImage2D, (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels), (target, level, xoffset, yoffset, width, height, format, type, pixels))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glCopyImageSubData, (GLuint srcName, GLenum srcTarget, GLint srcLevel, GLint srcX, GLint srcY, GLint srcZ, GLuint dstName, GLenum dstTarget, GLint dstLevel, GLint dstX, GLint dstY, GLint dstZ, GLsizei srcWidth, GLsizei srcHeight, GLsizei srcDepth), (srcName, srcTarget, srcLevel, srcX, srcY, srcZ, dstName, dstTarget, dstLevel, dstX, dstY, dstZ, srcWidth, srcHeight, srcDepth))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glGenVertexArrays, (GLsizei n, GLuint* arrays), (n, arrays))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glDeleteVertexArrays, (GLsizei n, const GLuint* arrays), (n, arrays))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glGenFramebuffers, (GLsizei n, GLuint* framebuffers), (n, framebuffers))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glDeleteFramebuffers, (GLsizei n, const GLuint* framebuffers), (n, framebuffers))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glGenQueries, (GLsizei n, GLuint* ids), (n, ids))
+GLTRACE_WRAP_VOID(GLTRACE_RESOURCE, glDeleteQueries, (GLsizei n, const GLuint* ids), (n, ids))
+
+// Queries
+GLTRACE_WRAP_RET(GLTRACE_QUERY, GLint, glGetUniformLocation, (GLuint program, const GLchar* name), (program, name))
+GLTRACE_WRAP_VOID(GLTRACE_QUERY, glGetShaderiv, (GLuint shader, GLenum pname, GLint* params), (shader, pname, params))
+GLTRACE_WRAP_VOID(GLTRACE_QUERY, glGetShaderInfoLog, (GLuint shader, GLsizei bufSize, GLsizei* length, GLchar* infoLog), (shader, bufSize, length, infoLog))
+GLTRACE_WRAP_VOID(GLTRACE_QUERY, glGetProgramiv, (GLuint program, GLenum pname, GLint* params), (program, pname, params))
+GLTRACE_WRAP_VOID(GLTRACE_QUERY, glGetProgramInfoLog, (GLuint program, GLsizei bufSize, GLsizei* length, GLchar* infoLog), (program, bufSize, length, infoLog))
+GLTRACE_WRAP_VOID(GLTRACE_QUERY, glGetBufferSubData, (GLenum target, GLintptr offset, GLsizeiptr size, void* data), (target, offset, size, data))
+GLTRACE_WRAP_VOID(GLTRACE_QUERY, glBeginQuery, (GLenum target, GLuint id), (target, id))
+GLTRACE_WRAP_VOID(GLTRACE_QUERY, glEndQuery, (GLenum target), (target))
+GLTRACE_WRAP_RET(GLTRACE_QUERY, GLsync, glFenceSync, (GLenum condition, GLbitfield flags), (condition, flags))
+GLTRACE_WRAP_RET(GLTRACE_QUERY, GLenum, glClientWaitSync, (GLsync sync, GLbitfield flags, GLuint64 timeout), (sync, flags, timeout))
+GLTRACE_WRAP_VOID(GLTRACE_QUERY, glDeleteSync, (GLsync sync), (sync))
+GLTRACE_WRAP_VOID(GLTRACE_QUERY, glGetIntegerv, (GLenum pname, GLint* data), (pname, data))
+GLTRACE_WRAP_VOID(GLTRACE_QUERY, glGetQueryObjectiv, (GLuint id, GLenum pname, GLint* params), (id, pname, params))
+GLTRACE_WRAP_VOID(GLTRACE_QUERY, glGetQueryObjectui64v, (GLuint id, GLenum pname, GLuint64* params), (id, pname, params))
+GLTRACE_WRAP_VOID(GLTRACE_QUERY, glGetFloatv, (GLenum pname, GLfloat* data), (pname, data))
+GLTRACE_WRAP_VOID(GLTRACE_QUERY, glGetVertexAttribiv, (GLuint index, GLenum pname, GLint* params), (index, pname, params))
+GLTRACE_WRAP_VOID(GLTRACE_QUERY, glGetVertexAttribPointerv, (GLuint index, GLenum pname, void** pointer), (index, pname, pointer))
+GLTRACE_WRAP_VOID(GLTRACE_QUERY, glGetBufferParameteriv, (GLenum target, GLenum pname, GLint* params), (target, pname, params))
+GLTRACE_WRAP_VOID(GLTRACE_QUERY, glQueryCounter, (GLuint id, GLenum target), (id, target))
+GLTRACE_WRAP_VOID(GLTRACE_QUERY, glGetInteger64v, (GLenum pname, GLint64* data), (pname, data))
+GLTRACE_WRAP_RET(GLTRACE_QUERY, GLenum, glCheckFramebufferStatus, (GLenum target), (target))
+GLTRACE_WRAP_RET(GLTRACE_QUERY, const GLubyte*, glGetString, (GLenum name), (name))
+
+// Route the GL names used by Source.cpp and its headers through the wrappers above
+#undef glClear
+#define glClear UTrace_glClear
+#undef glDrawArrays
+#define glDrawArrays UTrace_glDrawArrays
+#undef glDrawElements
+#define glDrawElements UTrace_glDrawElements
+#undef glEnable
+#define glEnable UTrace_glEnable
+#undef glDisable
+#define glDisable UTrace_glDisable
+#undef glDepthFunc
+#define glDepthFunc UTrace_glDepthFunc
+#undef glDepthMask
+#define glDepthMask UTrace_glDepthMask
+#undef glColorMask
+#define glColorMask UTrace_glColorMask
+#undef glClearColor
+#define glClearColor UTrace_glClearColor
+#undef glViewport
+#define glViewport UTrace_glViewport
+#undef glUseProgram
+#define glUseProgram UTrace_glUseProgram
+#undef glBindVertexArray
+#define glBindVertexArray UTrace_glBindVertexArray
+#undef glActiveTexture
+#define glActiveTexture UTrace_glActiveTexture
+#undef glBindTexture
+#define glBindTexture UTrace_glBindTexture
+#undef glTexParameteri
+#define glTexParameteri UTrace_glTexParameteri
+#undef glTexParameterfv
+#define glTexParameterfv UTrace_glTexParameterfv
+#undef glUniform1i
+#define glUniform1i UTrace_glUniform1i
+#undef glUniform1f
+#define glUniform1f UTrace_glUniform1f
+#undef glUniform2fv
+#define glUniform2fv UTrace_glUniform2fv
+#undef glUniform3fv
+#define glUniform3fv UTrace_glUniform3fv
+#undef glUniform4fv
+#define glUniform4fv UTrace_glUniform4fv
+#undef glUniform3f
+#define glUniform3f UTrace_glUniform3f
+#undef glUniformMatrix4fv
+#define glUniformMatrix4fv UTrace_glUniformMatrix4fv
+#undef glProgramUniform4f
+#define glProgramUniform4f UTrace_glProgramUniform4f
+#undef glGenTextures
+#define glGenTextures UTrace_glGenTextures
+#undef glDeleteTextures
+#define glDeleteTextures UTrace_glDeleteTextures
+#undef glTexImage2D
+#define glTexImage2D UTrace_glTexImage2D
+#undef glGenerateMipmap
+#define glGenerateMipmap UTrace_glGenerateMipmap
+#undef glCreateProgram
+#define glCreateProgram UTrace_glCreateProgram
+#undef glCreateShader
+#define glCreateShader UTrace_glCreateShader
+#undef glShaderSource
+#define glShaderSource UTrace_glShaderSource
+#undef glCompileShader
+#define glCompileShader UTrace_glCompileShader
+#undef glAttachShader
+#define glAttachShader UTrace_glAttachShader
+#undef glLinkProgram
+#define glLinkProgram UTrace_glLinkProgram
+#undef glDeleteProgram
+#define glDeleteProgram UTrace_glDeleteProgram
+#undef glGetUniformLocation
+#define glGetUniformLocation UTrace_glGetUniformLocation
+#undef glGetShaderiv
+#define glGetShaderiv UTrace_glGetShaderiv
+#undef glGetShaderInfoLog
+#define glGetShaderInfoLog UTrace_glGetShaderInfoLog
+#undef glGetProgramiv
+#define glGetProgramiv UTrace_glGetProgramiv
+#undef glGetProgramInfoLog
+#define glGetProgramInfoLog UTrace_glGetProgramInfoLog
+
+#undef glBlitFramebuffer
+#define glBlitFramebuffer UTrace_glBlitFramebuffer
+#undef glDispatchCompute
+#define glDispatchCompute UTrace_glDispatchCompute
+#undef glBindFramebuffer
+#define glBindFramebuffer UTrace_glBindFramebuffer
+#undef glBindImageTexture
+#define glBindImageTexture UTrace_glBindImageTexture
+#undef glMemoryBarrier
+#define glMemoryBarrier UTrace_glMemoryBarrier
+#undef glBindBuffer
+#define glBindBuffer UTrace_glBindBuffer
+#undef glBindBufferBase
+#define glBindBufferBase UTrace_glBindBufferBase
+#undef glBeginConditionalRender
+#define glBeginConditionalRender UTrace_glBeginConditionalRender
+#undef glEndConditionalRender
+#define glEndConditionalRender UTrace_glEndConditionalRender
+#undef glUniform1ui
+#define glUniform1ui UTrace_glUniform1ui
+#undef glBufferData
+#define glBufferData UTrace_glBufferData
+#undef glDeleteShader
+#define glDeleteShader UTrace_glDeleteShader
+#undef glGetBufferSubData
+#define glGetBufferSubData UTrace_glGetBufferSubData
+#undef glBeginQuery
+#define glBeginQuery UTrace_glBeginQuery
+#undef glEndQuery
+#define glEndQuery UTrace_glEndQuery
+#undef glFenceSync
+#define glFenceSync UTrace_glFenceSync
+#undef glClientWaitSync
+#define glClientWaitSync UTrace_glClientWaitSync
+#undef glDeleteSync
+#define glDeleteSync UTrace_glDeleteSync
+#undef glDrawElementsInstancedBaseInstance
+#define glDrawElementsInstancedBaseInstance UTrace_glDrawElementsInstancedBaseInstance
+#undef glDrawArraysInstancedBaseInstance
+#define glDrawArraysInstancedBaseInstance UTrace_glDrawArraysInstancedBaseInstance
+#undef glMultiDrawElementsIndirect
+#define glMultiDrawElementsIndirect UTrace_glMultiDrawElementsIndirect
+#undef glMultiDrawArraysIndirect
+#define glMultiDrawArraysIndirect UTrace_glMultiDrawArraysIndirect
+#undef glMultiDrawElementsIndirectCount
+#define glMultiDrawElementsIndirectCount UTrace_glMultiDrawElementsIndirectCount
+#undef glMultiDrawArraysIndirectCount
+#define glMultiDrawArraysIndirectCount UTrace_glMultiDrawArraysIndirectCount
+#undef glMultiDrawElementsIndirectCountARB
+#define glMultiDrawElementsIndirectCountARB UTrace_glMultiDrawElementsIndirectCountARB
+#undef glMultiDrawArraysIndirectCountARB
+#define glMultiDrawArraysIndirectCountARB UTrace_glMultiDrawArraysIndirectCountARB
+#undef glClearBufferData
+#define glClearBufferData UTrace_glClearBufferData
+#undef glProgramUniformMatrix4fv
+#define glProgramUniformMatrix4fv UTrace_glProgramUniformMatrix4fv
+#undef glProgramUniform2fv
+#define glProgramUniform2fv UTrace_glProgramUniform2fv
+#undef glGenBuffers
+#define glGenBuffers UTrace_glGenBuffers
+#undef glDeleteBuffers
+#define glDeleteBuffers UTrace_glDeleteBuffers
+#undef glBufferSubData
+#define glBufferSubData UTrace_glBufferSubData
+#undef glBindBufferRange
+#define glBindBufferRange UTrace_glBindBufferRange
+#undef glBufferStorage
+#define glBufferStorage UTrace_glBufferStorage
+#undef glMapBufferRange
+#define glMapBufferRange UTrace_glMapBufferRange
+#undef glUnmapBuffer
+#define glUnmapBuffer UTrace_glUnmapBuffer
+#undef glGetIntegerv
+#define glGetIntegerv UTrace_glGetIntegerv
+#undef glUniform2f
+#define glUniform2f UTrace_glUniform2f
+#undef glGetQueryObjectiv
+#define glGetQueryObjectiv UTrace_glGetQueryObjectiv
+#undef glGetQueryObjectui64v
+#define glGetQueryObjectui64v UTrace_glGetQueryObjectui64v
+#undef glBindSampler
+#define glBindSampler UTrace_glBindSampler
+#undef glGenSamplers
+#define glGenSamplers UTrace_glGenSamplers
+#undef glDeleteSamplers
+#define glDeleteSamplers UTrace_glDeleteSamplers
+#undef glSamplerParameteri
+#define glSamplerParameteri UTrace_glSamplerParameteri
+#undef glSamplerParameterf
+#define glSamplerParameterf UTrace_glSamplerParameterf
+#undef glSamplerParameterfv
+#define glSamplerParameterfv UTrace_glSamplerParameterfv
+#undef glGetFloatv
+#define glGetFloatv UTrace_glGetFloatv
+#undef glTexStorage2D
+#define glTexStorage2D UTrace_glTexStorage2D
+#undef glTexSubImage2D
+#define glTexSubImage2D UTrace_glTexSubImage2D
+#undef glCopyImageSubData
+#define glCopyImageSubData UTrace_glCopyImageSubData
+#undef glPixelStorei
+#define glPixelStorei UTrace_glPixelStorei
+#undef glGetVertexAttribiv
+#define glGetVertexAttribiv UTrace_glGetVertexAttribiv
+#undef glGetVertexAttribPointerv
+#define glGetVertexAttribPointerv UTrace_glGetVertexAttribPointerv
+#undef glGetBufferParameteriv
+#define glGetBufferParameteriv UTrace_glGetBufferParameteriv
+#undef glReadPixels
+#define glReadPixels UTrace_glReadPixels
+#undef glEnableVertexAttribArray
+#define glEnableVertexAttribArray UTrace_glEnableVertexAttribArray
+#undef glVertexAttribPointer
+#define glVertexAttribPointer UTrace_glVertexAttribPointer
+#undef glVertexAttribIPointer
+#define glVertexAttribIPointer UTrace_glVertexAttribIPointer
+#undef glVertexAttribDivisor
+#define glVertexAttribDivisor UTrace_glVertexAttribDivisor
+#undef glFramebufferTexture2D
+#define glFramebufferTexture2D UTrace_glFramebufferTexture2D
+#undef glGenVertexArrays
+#define glGenVertexArrays UTrace_glGenVertexArrays
+#undef glDeleteVertexArrays
+#define glDeleteVertexArrays UTrace_glDeleteVertexArrays
+#undef glGenFramebuffers
+#define glGenFramebuffers UTrace_glGenFramebuffers
+#undef glDeleteFramebuffers
+#define glDeleteFramebuffers UTrace_glDeleteFramebuffers
+#undef glGenQueries
+#define glGenQueries UTrace_glGenQueries
+#undef glDeleteQueries
+#define glDeleteQueries UTrace_glDeleteQueries
+#undef glQueryCounter
+#define glQueryCounter UTrace_glQueryCounter
+#undef glGetInteger64v
+#define glGetInteger64v UTrace_glGetInteger64v
+#undef glCheckFramebufferStatus
+#define glCheckFramebufferStatus UTrace_glCheckFramebufferStatus
+#undef glGetString
+#define glGetString UTrace_glGetString
+
+#endif // GL_TRACE
+
+#endif // GLTRACE_H
@@ -0,0 +1,295 @@
+#ifndef GPUDRIVEN_H
+#define GPUDRIVEN_H
+
+#include <GL/glew.h>        // GLEW library
+
+#include <vector>
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "culling.h"        // Hi-Z pyramid, bounds buffer and the shared visibility test
+
+/* GPU-driven culling and draw submission
+ * --------------------------------------
+ * Every draw of the scene is described once by a GpuDrawRecord (object, batch, and the
+ * indirect command to emit). Each frame a compute shader tests every record's object
+ * bounds against the frustum and the previous frame's Hi-Z pyramid, and visible records
+ * append a DrawElementsIndirectCommand / DrawArraysIndirectCommand to their batch with an
+ * atomic counter. Batches (same VAO, primitive mode, shader and texture unit) are then
+ * drawn with one glMultiDraw*IndirectCount call each, so the CPU cost per frame depends on
+ * the number of batches, not on the number of objects.
+ *
+ * The object index reaches the shaders as the command's base instance, which selects the
+ * object's entry in the per-object data SSBO.
+ *
+ * Without GL 4.6 or ARB_indirect_parameters the commands are not compacted: every record
+ * keeps a fixed slot, culled ones get an instance count of 0, and each batch is drawn with
+ * glMultiDraw*Indirect over all of its slots.
+ */
+
+// One indirect draw of one object
+struct GpuDrawRecord
+{
+	GLuint objectIndex;
+	GLuint batch;
+	GLuint commandOffset;	// first command of the batch
+	GLuint commandSlot;		// fixed slot inside the batch when commands are not compacted
+	GLuint indexed;
+	GLuint count;
+	GLuint first;			// first index or first vertex
+	GLint baseVertex;
+};
+
+// Draws sharing VAO, primitive mode, shader and texture unit, submitted with one multi-draw
+struct GpuDrawBatch
+{
+	GLuint vao;
+	GLenum mode;
+	bool indexed;
+	bool isLight;
+	bool lightmapped;		// static objects drawn with the baked lighting shader
+	GLint textureUnit;
+	GLuint commandOffset;
+	GLuint maxCount;
+};
+
+const GLchar* gpuCullComputeShaderSource = GLSL(440,
+	layout(local_size_x = 64) in;
+
+struct ObjectBounds
+{
+	vec4 boundsMin;
+	vec4 boundsMax;
+};
+
+struct DrawRecord
+{
+	uint objectIndex;
+	uint batch;
+	uint commandOffset;
+	uint commandSlot;
+	uint indexed;
+	uint count;
+	uint first;
+	int baseVertex;
+};
+
+// Matches DrawElementsIndirectCommand; array draws use the first four fields as DrawArraysIndirectCommand
+struct DrawCommand
+{
+	uint count;
+	uint instanceCount;
+	uint first;
+	uint baseVertexOrInstance;
+	uint baseInstance;
+};
+
+layout(std430, binding = 0) readonly buffer BoundsBuffer { ObjectBounds bounds[]; };
+layout(std430, binding = 3) readonly buffer RecordBuffer { DrawRecord records[]; };
+layout(std430, binding = 4) writeonly buffer CommandBuffer { DrawCommand commands[]; };
+layout(std430, binding = 5) buffer CountBuffer { uint counts[]; };
+
+uniform uint recordCount;
+uniform bool compact;
+);
+
+const GLchar* gpuCullComputeMainSource = GLSL_SOURCE(
+void main()
+{
+	uint index = gl_GlobalInvocationID.x;
+	if (index >= recordCount)
+		return;
+
+	DrawRecord record = records[index];
+	bool visible = UBoundsVisible(bounds[record.objectIndex].boundsMin.xyz, bounds[record.objectIndex].boundsMax.xyz);
+
+	uint slot = record.commandSlot;
+	if (compact)
+	{
+		if (!visible)
+			return;
+		slot = atomicAdd(counts[record.batch], 1u);
+	}
+
+	DrawCommand command;
+	command.count = record.count;
+	command.instanceCount = visible ? 1u : 0u;
+	command.first = record.first;
+	if (record.indexed != 0u)
+	{
+		command.baseVertexOrInstance = uint(record.baseVertex);
+		command.baseInstance = record.objectIndex;
+	}
+	else
+	{
+		command.baseVertexOrInstance = record.objectIndex;
+		command.baseInstance = 0u;
+	}
+	commands[record.commandOffset + slot] = command;
+}
+);
+
+
+class GpuDrivenRenderer
+{
+public:
+	bool Initialize()
+	{
+		const char* sources[] = { gpuCullComputeShaderSource, hizVisibilityShaderSource, gpuCullComputeMainSource };
+		if (!UCreateComputeProgram(sources, 3, mCullProgramId))
+			return false;
+
+		mRecordCountLoc = glGetUniformLocation(mCullProgramId, "recordCount");
+		mCompactLoc = glGetUniformLocation(mCullProgramId, "compact");
+		mViewProjectionLoc = glGetUniformLocation(mCullProgramId, "viewProjection");
+		mHizLevelsLoc = glGetUniformLocation(mCullProgramId, "hizLevels");
+		mHizValidLoc = glGetUniformLocation(mCullProgramId, "hizValid");
+
+		glGenBuffers(1, &mRecordBuffer);
+		glGenBuffers(1, &mCommandBuffer);
+		glGenBuffers(1, &mCountBuffer);
+
+		if (GLEW_VERSION_4_6)
+			mCountPath = COUNT_CORE;
+		else if (GLEW_ARB_indirect_parameters)
+			mCountPath = COUNT_ARB;
+		else
+			mCountPath = COUNT_NONE;
+
+		mInitialized = true;
+		return true;
+	}
+
+	void Destroy()
+	{
+		if (!mInitialized)
+			return;
+
+		glDeleteBuffers(1, &mRecordBuffer);
+		glDeleteBuffers(1, &mCommandBuffer);
+		glDeleteBuffers(1, &mCountBuffer);
+		glDeleteProgram(mCullProgramId);
+		mInitialized = false;
+	}
+
+	// Uploads the draw records and batch layout; call whenever the scene changes
+	void SetDraws(const std::vector<GpuDrawRecord>& records, const std::vector<GpuDrawBatch>& batches)
+	{
+		mRecordCount = (GLuint)records.size();
+		mBatches = batches;
+
+		GLuint commandCount = 0;
+		for (const GpuDrawBatch& batch : mBatches)
+			commandCount += batch.maxCount;
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, mRecordBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, (records.empty() ? 1 : records.size()) * sizeof(GpuDrawRecord), records.empty() ? NULL : records.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, mCommandBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, (commandCount ? commandCount : 1) * COMMAND_STRIDE, NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, mCountBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, (mBatches.empty() ? 1 : mBatches.size()) * sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	const std::vector<GpuDrawBatch>& Batches() const { return mBatches; }
+
+	// Culls every record on the GPU and writes this frame's indirect commands
+	void Cull(const glm::mat4& viewProjection, const OcclusionCuller& occlusion, bool useOcclusion)
+	{
+		if (!mInitialized || mRecordCount == 0)
+			return;
+
+		bool compact = mCountPath != COUNT_NONE;
+		if (compact)
+		{
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, mCountBuffer);
+			glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		}
+
+		bool hizValid = useOcclusion && occlusion.HasHiz();
+		glActiveTexture(GL_TEXTURE7);
+		glBindTexture(GL_TEXTURE_2D, hizValid ? occlusion.HizTexture() : 0);
+
+		glUseProgram(mCullProgramId);
+		glUniformMatrix4fv(mViewProjectionLoc, 1, GL_FALSE, glm::value_ptr(viewProjection));
+		glUniform1ui(mRecordCountLoc, mRecordCount);
+		glUniform1i(mCompactLoc, compact);
+		glUniform1i(mHizLevelsLoc, occlusion.HizLevels());
+		glUniform1i(mHizValidLoc, hizValid);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, occlusion.BoundsBuffer());
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, mRecordBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, mCommandBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, mCountBuffer);
+		glDispatchCompute((mRecordCount + 63) / 64, 1, 1);
+
+		// Commands and counts are consumed as indirect / parameter buffers
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+	}
+
+	// Draws one batch with the program and texture state already set by the caller
+	void DrawBatch(size_t index)
+	{
+		const GpuDrawBatch& batch = mBatches[index];
+		const void* commands = (const void*)(size_t)(batch.commandOffset * COMMAND_STRIDE);
+		GLintptr countOffset = (GLintptr)(index * sizeof(GLuint));
+
+		glBindVertexArray(batch.vao);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mCommandBuffer);
+
+		switch (mCountPath)
+		{
+		case COUNT_CORE:
+			glBindBuffer(GL_PARAMETER_BUFFER, mCountBuffer);
+			if (batch.indexed)
+				glMultiDrawElementsIndirectCount(batch.mode, GL_UNSIGNED_INT, commands, countOffset, batch.maxCount, COMMAND_STRIDE);
+			else
+				glMultiDrawArraysIndirectCount(batch.mode, commands, countOffset, batch.maxCount, COMMAND_STRIDE);
+			break;
+		case COUNT_ARB:
+			glBindBuffer(GL_PARAMETER_BUFFER_ARB, mCountBuffer);
+			if (batch.indexed)
+				glMultiDrawElementsIndirectCountARB(batch.mode, GL_UNSIGNED_INT, commands, countOffset, batch.maxCount, COMMAND_STRIDE);
+			else
+				glMultiDrawArraysIndirectCountARB(batch.mode, commands, countOffset, batch.maxCount, COMMAND_STRIDE);
+			break;
+		default:
+			if (batch.indexed)
+				glMultiDrawElementsIndirect(batch.mode, GL_UNSIGNED_INT, commands, batch.maxCount, COMMAND_STRIDE);
+			else
+				glMultiDrawArraysIndirect(batch.mode, commands, batch.maxCount, COMMAND_STRIDE);
+			break;
+		}
+	}
+
+private:
+	enum CountPath
+	{
+		COUNT_NONE,
+		COUNT_CORE,
+		COUNT_ARB
+	};
+
+	static const GLsizei COMMAND_STRIDE = 5 * sizeof(GLuint);
+
+	bool mInitialized = false;
+	CountPath mCountPath = COUNT_NONE;
+
+	GLuint mCullProgramId = 0;
+	GLint mRecordCountLoc = -1;
+	GLint mCompactLoc = -1;
+	GLint mViewProjectionLoc = -1;
+	GLint mHizLevelsLoc = -1;
+	GLint mHizValidLoc = -1;
+
+	GLuint mRecordBuffer = 0;
+	GLuint mCommandBuffer = 0;
+	GLuint mCountBuffer = 0;
+	GLuint mRecordCount = 0;
+
+	std::vector<GpuDrawBatch> mBatches;
+};
+
+#endif // GPUDRIVEN_H
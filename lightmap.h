@@ -0,0 +1,528 @@
+#ifndef LIGHTMAP_H
+#define LIGHTMAP_H
+
+#include <GL/glew.h>        // GLEW library
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "log.h"
+
+/* Baked lighting
+ * --------------
+ * Static objects take the diffuse part of their two Phong lights from a lightmap atlas,
+ * and the shader only computes ambient and the view-dependent specular terms.
+ *
+ * Every mesh that static objects use gets a second UV set in a [0,1] chart. The mesh is
+ * unrolled into a triangle list, and each triangle is laid out in its own cell of a square
+ * grid, inset by CellPadding so that bilinear filtering never reads a neighbouring
+ * triangle. Each static object owns a square region of the atlas. Its size follows the
+ * object's world-space surface area at TexelsPerUnit, as a whole number of texels per
+ * cell. Regions are shelf-packed, largest first.
+ *
+ * The bake runs on all hardware threads, with an atomic counter handing out bands of
+ * rows. Each texel center in a cell is mapped back to the triangle through its
+ * barycentrics and lit exactly as the surface shader lights a fragment:
+ * max(dot(n, l), 0) * color, summed over the object's two lights. Texels just outside a
+ * triangle are then dilated from their baked neighbours. The result is cached on disk
+ * next to the scene, keyed by a hash of every bake input, so later runs only read it
+ * back.
+ */
+
+const char LIGHTMAP_CACHE_MAGIC[4] = { 'L', 'M', 'A', 'P' };
+const uint32_t LIGHTMAP_CACHE_VERSION = 1;
+
+// Vertex of an unrolled mesh with its lightmap chart coordinate
+struct LightmapVertex
+{
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec2 uv;
+	glm::vec2 lightmapUv;
+};
+
+// One static object to bake: the chart of its mesh, its transform and its material's lights
+struct LightmapObject
+{
+	int chart;
+	glm::mat4 model;
+	glm::vec3 light1Color;
+	glm::vec3 light1Position;
+	glm::vec3 light2Color;
+	glm::vec3 light2Position;
+};
+
+class LightmapBaker
+{
+public:
+	// Atlas density and limits; a scene that does not fit is baked at half the density until it does
+	float TexelsPerUnit = 16.0f;
+	int MaxRegionSize = 1024;
+	int MaxAtlasSize = 4096;
+	int MinCellTexels = 8;					// with CellPadding, at least one texel of padding per side
+	float CellPadding = 0.125f;				// fraction of a cell left empty on each side of its triangle
+
+	// Lays a triangle list out in a chart, one padded grid cell per triangle; returns the grid size
+	int BuildChart(std::vector<LightmapVertex>& triangles) const
+	{
+		int count = (int)triangles.size() / 3;
+		int grid = std::max(1, (int)std::ceil(std::sqrt((float)count)));
+		float low = CellPadding;
+		float high = 1.0f - CellPadding;
+		for (int i = 0; i < count; ++i)
+		{
+			glm::vec2 cell((float)(i % grid), (float)(i / grid));
+			triangles[3 * i].lightmapUv = (cell + glm::vec2(low, low)) / (float)grid;
+			triangles[3 * i + 1].lightmapUv = (cell + glm::vec2(high, low)) / (float)grid;
+			triangles[3 * i + 2].lightmapUv = (cell + glm::vec2(low, high)) / (float)grid;
+		}
+		return grid;
+	}
+
+	// Registers the chart built for a mesh; charts are referenced by LightmapObject::chart
+	void SetChart(int chart, const std::vector<LightmapVertex>& triangles, int grid)
+	{
+		if (chart >= (int)mCharts.size())
+			mCharts.resize(chart + 1);
+		mCharts[chart].triangles = triangles;
+		mCharts[chart].grid = grid;
+	}
+
+	// Bakes the objects into a new atlas, or loads it from cachePath when the inputs are unchanged
+	bool Bake(const std::vector<LightmapObject>& objects, const std::string& cachePath)
+	{
+		mWidth = mHeight = 0;
+		mTexels.clear();
+		mRegions.assign(objects.size(), glm::vec4(0.0f));
+		if (objects.empty())
+			return true;
+
+		for (const LightmapObject& object : objects)
+		{
+			if (object.chart < 0 || object.chart >= (int)mCharts.size() || mCharts[object.chart].triangles.empty())
+			{
+				ULOG_ERROR("Lightmap object uses chart %d, which has not been built", object.chart);
+				return false;
+			}
+		}
+
+		uint64_t hash = Hash(objects);
+		if (!cachePath.empty() && Load(cachePath, hash, objects.size()))
+		{
+			ULOG_INFO("Lightmap: %dx%d for %zu static objects loaded from %s", mWidth, mHeight, objects.size(), cachePath.c_str());
+			return true;
+		}
+
+		std::vector<Region> regions;
+		if (!Pack(objects, regions))
+			return false;
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		mTexels.assign((size_t)mWidth * mHeight * 3, 0.0f);
+		std::vector<unsigned char> covered((size_t)mWidth * mHeight, 0);
+
+		// Bands of rows, so one large region still spreads over every thread
+		struct Band { size_t region; int first; int last; };
+		std::vector<Band> bands;
+		for (size_t r = 0; r < regions.size(); ++r)
+		{
+			for (int row = 0; row < regions[r].size; row += BAND_ROWS)
+			{
+				int last = row + BAND_ROWS;
+				bands.push_back({ r, row, std::min(last, regions[r].size) });
+			}
+		}
+		ParallelFor(bands.size(), [&](size_t b)
+			{
+				const Band& band = bands[b];
+				BakeRows(objects[band.region], regions[band.region], band.first, band.last, covered);
+			});
+
+		// Dilation reads neighbouring rows, so it runs per region once every band is done
+		ParallelFor(regions.size(), [&](size_t r) { Dilate(regions[r], covered); });
+
+		for (size_t r = 0; r < regions.size(); ++r)
+		{
+			const Region& region = regions[r];
+			mRegions[r] = glm::vec4((float)region.size / mWidth, (float)region.size / mHeight, (float)region.x / mWidth, (float)region.y / mHeight);
+		}
+
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		ULOG_INFO("Lightmap: baked %dx%d for %zu static objects on %u threads in %.1f ms", mWidth, mHeight, objects.size(), ThreadCount(), ms);
+
+		if (!cachePath.empty() && !Save(cachePath, hash))
+			ULOG_WARNING("Failed to write the lightmap cache %s", cachePath.c_str());
+		return true;
+	}
+
+	// Uploads the atlas as an RGB16F texture bound to a unit
+	void Upload(int unit)
+	{
+		Destroy();
+		if (mTexels.empty())
+			return;
+
+		glGenTextures(1, &mTexture);
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D, mTexture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGB16F, mWidth, mHeight);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, mWidth, mHeight, GL_RGB, GL_FLOAT, mTexels.data());
+	}
+
+	void Destroy()
+	{
+		if (mTexture)
+			glDeleteTextures(1, &mTexture);
+		mTexture = 0;
+	}
+
+	// Per object of the last bake: atlas scale (xy) and offset (zw) of its chart
+	const std::vector<glm::vec4>& Regions() const { return mRegions; }
+
+private:
+	static const int BAND_ROWS = 16;
+	static const int DILATE_PASSES = 2;
+
+	struct CacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t hash;
+		int32_t width;
+		int32_t height;
+		uint32_t objectCount;
+		uint32_t reserved;
+	};
+
+	struct Chart
+	{
+		std::vector<LightmapVertex> triangles;
+		int grid = 1;
+	};
+
+	struct Region
+	{
+		int x = 0;
+		int y = 0;
+		int size = 0;			// texels across, a multiple of the chart grid
+	};
+
+	static unsigned ThreadCount()
+	{
+		return std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	// Runs work(i) for i in [0, count) on every hardware thread
+	template<typename Work>
+	static void ParallelFor(size_t count, Work work)
+	{
+		std::atomic<size_t> next{ 0 };
+		auto worker = [&]()
+			{
+				for (size_t i = next++; i < count; i = next++)
+					work(i);
+			};
+
+		std::vector<std::thread> threads;
+		unsigned threadCount = (unsigned)std::min<size_t>(ThreadCount(), count);
+		for (unsigned t = 1; t < threadCount; ++t)
+			threads.emplace_back(worker);
+		worker();
+		for (std::thread& thread : threads)
+			thread.join();
+	}
+
+	// World-space surface area of an object
+	float SurfaceArea(const LightmapObject& object) const
+	{
+		const std::vector<LightmapVertex>& triangles = mCharts[object.chart].triangles;
+		float area = 0.0f;
+		for (size_t i = 0; i + 2 < triangles.size(); i += 3)
+		{
+			glm::vec3 a = glm::vec3(object.model * glm::vec4(triangles[i].position, 1.0f));
+			glm::vec3 b = glm::vec3(object.model * glm::vec4(triangles[i + 1].position, 1.0f));
+			glm::vec3 c = glm::vec3(object.model * glm::vec4(triangles[i + 2].position, 1.0f));
+			area += 0.5f * glm::length(glm::cross(b - a, c - a));
+		}
+		return area;
+	}
+
+	// Sizes the regions and shelf-packs them; halves the density until the atlas fits
+	bool Pack(const std::vector<LightmapObject>& objects, std::vector<Region>& regions)
+	{
+		std::vector<float> areas(objects.size());
+		for (size_t i = 0; i < objects.size(); ++i)
+			areas[i] = SurfaceArea(objects[i]);
+
+		for (float density = TexelsPerUnit; density >= 0.25f; density *= 0.5f)
+		{
+			regions.assign(objects.size(), Region());
+			size_t totalTexels = 0;
+			int largest = 0;
+			for (size_t i = 0; i < objects.size(); ++i)
+			{
+				int grid = mCharts[objects[i].chart].grid;
+				int cellTexels = (int)std::ceil(std::sqrt(areas[i]) * density / grid);
+				cellTexels = std::max(MinCellTexels, std::min(cellTexels, std::max(MaxRegionSize / grid, MinCellTexels)));
+				regions[i].size = cellTexels * grid;
+				totalTexels += (size_t)regions[i].size * regions[i].size;
+				largest = std::max(largest, regions[i].size);
+			}
+			if (largest > MaxAtlasSize)
+				continue;
+
+			// Power-of-two width around the square root of the total, then shelves tallest first
+			int width = 1;
+			while (width < largest || (size_t)width * width < totalTexels)
+				width *= 2;
+			width = std::min(width, MaxAtlasSize);
+
+			std::vector<size_t> order(objects.size());
+			for (size_t i = 0; i < order.size(); ++i)
+				order[i] = i;
+			std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return regions[a].size > regions[b].size; });
+
+			int x = 0, y = 0, shelfHeight = 0;
+			for (size_t i : order)
+			{
+				Region& region = regions[i];
+				if (x + region.size > width)
+				{
+					x = 0;
+					y += shelfHeight;
+					shelfHeight = 0;
+				}
+				region.x = x;
+				region.y = y;
+				x += region.size;
+				shelfHeight = std::max(shelfHeight, region.size);
+			}
+
+			int height = y + shelfHeight;
+			if (height <= MaxAtlasSize)
+			{
+				mWidth = width;
+				mHeight = height;
+				if (density < TexelsPerUnit)
+					ULOG_WARNING("Lightmap: static objects baked at %g texels per unit to fit %dx%d", density, MaxAtlasSize, MaxAtlasSize);
+				return true;
+			}
+		}
+
+		ULOG_ERROR("Lightmap: %zu static objects do not fit a %dx%d atlas", objects.size(), MaxAtlasSize, MaxAtlasSize);
+		return false;
+	}
+
+	// Lights the texels of rows [first, last) of a region whose centers fall on (or half a texel off) a triangle
+	void BakeRows(const LightmapObject& object, const Region& region, int first, int last, std::vector<unsigned char>& covered)
+	{
+		const Chart& chart = mCharts[object.chart];
+		int cellTexels = region.size / chart.grid;
+		int triangleCount = (int)chart.triangles.size() / 3;
+		float span = 1.0f - 2.0f * CellPadding;
+		float slack = 0.5f / (cellTexels * span);
+		glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(object.model)));
+
+		for (int row = first; row < last; ++row)
+		{
+			int cellY = row / cellTexels;
+			for (int column = 0; column < region.size; ++column)
+			{
+				int cellX = column / cellTexels;
+				int triangle = cellY * chart.grid + cellX;
+				if (triangle >= triangleCount)
+					break;
+
+				// Barycentrics of the texel center in the cell's right triangle
+				float s = (((column % cellTexels) + 0.5f) / cellTexels - CellPadding) / span;
+				float t = (((row % cellTexels) + 0.5f) / cellTexels - CellPadding) / span;
+				if (s < -slack || t < -slack || s + t > 1.0f + slack)
+					continue;
+				s = std::max(s, 0.0f);
+				t = std::max(t, 0.0f);
+				if (s + t > 1.0f)
+				{
+					float scale = 1.0f / (s + t);
+					s *= scale;
+					t *= scale;
+				}
+
+				const LightmapVertex* corners = &chart.triangles[3 * triangle];
+				float r = 1.0f - s - t;
+				glm::vec3 position = corners[0].position * r + corners[1].position * s + corners[2].position * t;
+				glm::vec3 normal = corners[0].normal * r + corners[1].normal * s + corners[2].normal * t;
+
+				// Same diffuse terms as the surface shader
+				glm::vec3 worldPosition = glm::vec3(object.model * glm::vec4(position, 1.0f));
+				glm::vec3 worldNormal = glm::normalize(normalMatrix * normal);
+				float impact1 = std::max(glm::dot(worldNormal, glm::normalize(object.light1Position - worldPosition)), 0.0f);
+				float impact2 = std::max(glm::dot(worldNormal, glm::normalize(object.light2Position - worldPosition)), 0.0f);
+				glm::vec3 diffuse = impact1 * object.light1Color + impact2 * object.light2Color;
+
+				size_t texel = (size_t)(region.y + row) * mWidth + region.x + column;
+				mTexels[3 * texel] = diffuse.x;
+				mTexels[3 * texel + 1] = diffuse.y;
+				mTexels[3 * texel + 2] = diffuse.z;
+				covered[texel] = 1;
+			}
+		}
+	}
+
+	// Grows the baked texels of a region into the padding around them, averaging baked neighbours
+	void Dilate(const Region& region, std::vector<unsigned char>& covered)
+	{
+		std::vector<size_t> filled;
+		for (int pass = 0; pass < DILATE_PASSES; ++pass)
+		{
+			filled.clear();
+			for (int y = region.y; y < region.y + region.size; ++y)
+			{
+				for (int x = region.x; x < region.x + region.size; ++x)
+				{
+					size_t texel = (size_t)y * mWidth + x;
+					if (covered[texel])
+						continue;
+
+					glm::vec3 sum(0.0f);
+					int count = 0;
+					for (int dy = -1; dy <= 1; ++dy)
+					{
+						for (int dx = -1; dx <= 1; ++dx)
+						{
+							int nx = x + dx, ny = y + dy;
+							if (nx < region.x || ny < region.y || nx >= region.x + region.size || ny >= region.y + region.size)
+								continue;
+							size_t neighbour = (size_t)ny * mWidth + nx;
+							if (covered[neighbour] != 1)
+								continue;
+							sum += glm::vec3(mTexels[3 * neighbour], mTexels[3 * neighbour + 1], mTexels[3 * neighbour + 2]);
+							++count;
+						}
+					}
+					if (count == 0)
+						continue;
+
+					sum = sum / (float)count;
+					mTexels[3 * texel] = sum.x;
+					mTexels[3 * texel + 1] = sum.y;
+					mTexels[3 * texel + 2] = sum.z;
+					filled.push_back(texel);
+				}
+			}
+
+			// Texels filled in this pass only feed the next one
+			for (size_t texel : filled)
+				covered[texel] = 1;
+		}
+	}
+
+	// FNV-1a over everything that affects the baked texels
+	uint64_t Hash(const std::vector<LightmapObject>& objects) const
+	{
+		uint64_t hash = 14695981039346656037ull;
+		auto add = [&hash](const void* data, size_t size)
+			{
+				const unsigned char* bytes = (const unsigned char*)data;
+				for (size_t i = 0; i < size; ++i)
+				{
+					hash ^= bytes[i];
+					hash *= 1099511628211ull;
+				}
+			};
+
+		add(&LIGHTMAP_CACHE_VERSION, sizeof(LIGHTMAP_CACHE_VERSION));
+		add(&TexelsPerUnit, sizeof(TexelsPerUnit));
+		add(&MaxRegionSize, sizeof(MaxRegionSize));
+		add(&MaxAtlasSize, sizeof(MaxAtlasSize));
+		add(&MinCellTexels, sizeof(MinCellTexels));
+		add(&CellPadding, sizeof(CellPadding));
+		for (const Chart& chart : mCharts)
+		{
+			add(&chart.grid, sizeof(chart.grid));
+			if (!chart.triangles.empty())
+				add(chart.triangles.data(), chart.triangles.size() * sizeof(LightmapVertex));
+		}
+		for (const LightmapObject& object : objects)
+		{
+			add(&object.chart, sizeof(object.chart));
+			add(&object.model[0][0], sizeof(object.model));
+			add(&object.light1Color[0], sizeof(object.light1Color));
+			add(&object.light1Position[0], sizeof(object.light1Position));
+			add(&object.light2Color[0], sizeof(object.light2Color));
+			add(&object.light2Position[0], sizeof(object.light2Position));
+		}
+		return hash;
+	}
+
+	// Cache layout: CacheHeader, one vec4 region per object, then width * height RGB floats
+	bool Save(const std::string& path, uint64_t hash) const
+	{
+		FILE* file = fopen(path.c_str(), "wb");
+		if (!file)
+			return false;
+
+		CacheHeader header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, LIGHTMAP_CACHE_MAGIC, sizeof(header.magic));
+		header.version = LIGHTMAP_CACHE_VERSION;
+		header.hash = hash;
+		header.width = mWidth;
+		header.height = mHeight;
+		header.objectCount = (uint32_t)mRegions.size();
+
+		bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+			fwrite(mRegions.data(), sizeof(glm::vec4), mRegions.size(), file) == mRegions.size() &&
+			fwrite(mTexels.data(), sizeof(float), mTexels.size(), file) == mTexels.size();
+		return fclose(file) == 0 && written;
+	}
+
+	bool Load(const std::string& path, uint64_t hash, size_t objectCount)
+	{
+		FILE* file = fopen(path.c_str(), "rb");
+		if (!file)
+			return false;
+
+		CacheHeader header;
+		bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+			std::memcmp(header.magic, LIGHTMAP_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+			header.version == LIGHTMAP_CACHE_VERSION && header.hash == hash && header.objectCount == objectCount &&
+			header.width > 0 && header.height > 0 && header.width <= MaxAtlasSize && header.height <= MaxAtlasSize;
+		if (valid)
+		{
+			mWidth = header.width;
+			mHeight = header.height;
+			mTexels.resize((size_t)mWidth * mHeight * 3);
+			valid = fread(mRegions.data(), sizeof(glm::vec4), mRegions.size(), file) == mRegions.size() &&
+				fread(mTexels.data(), sizeof(float), mTexels.size(), file) == mTexels.size();
+		}
+		fclose(file);
+
+		if (!valid)
+		{
+			mWidth = mHeight = 0;
+			mTexels.clear();
+			mRegions.assign(objectCount, glm::vec4(0.0f));
+		}
+		return valid;
+	}
+
+	std::vector<Chart> mCharts;
+	std::vector<glm::vec4> mRegions;
+	std::vector<float> mTexels;			// RGB, rows bottom to top
+	int mWidth = 0;
+	int mHeight = 0;
+	GLuint mTexture = 0;
+};
+
+#endif // LIGHTMAP_H
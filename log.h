@@ -0,0 +1,252 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+/* Asynchronous logging
+ * --------------------
+ * ULOG_* formats a record (printf style) straight into a slot of a fixed, lock-free
+ * multi-producer / single-consumer ring and returns; a background thread drains the ring
+ * to stdout and only flushes once the ring runs empty. Producers never lock, allocate or
+ * touch I/O: when the ring is full the record is dropped and counted, and the drop count
+ * is reported with the next record that gets through.
+ *
+ * Levels below LOG_MIN_LEVEL compile to nothing (arguments are not evaluated). The
+ * *_EVERY variants rate-limit a call site, for messages that fire every frame while a key
+ * is held.
+ */
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_ERROR 3
+
+#ifndef LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#else
+#define LOG_MIN_LEVEL LOG_LEVEL_DEBUG
+#endif
+#endif
+
+class Logger
+{
+public:
+	static const size_t CAPACITY = 1024;		// power of two
+	static const size_t MESSAGE_SIZE = 512;
+
+	Logger()
+	{
+		for (size_t i = 0; i < CAPACITY; ++i)
+			mSlots[i].sequence.store(i, std::memory_order_relaxed);
+		mStart = std::chrono::steady_clock::now();
+	}
+
+	~Logger() { Stop(); }
+
+	// Starts the writer thread; records logged before this are kept until it runs
+	void Start()
+	{
+		std::lock_guard<std::mutex> lock(mThreadMutex);
+		if (mThread.joinable())
+			return;
+		mQuit = false;
+		mThread = std::thread(&Logger::Run, this);
+	}
+
+	// Drains everything still queued and stops the writer thread
+	void Stop()
+	{
+		std::lock_guard<std::mutex> lock(mThreadMutex);
+		if (!mThread.joinable())
+			return;
+		{
+			std::lock_guard<std::mutex> wakeLock(mWakeMutex);
+			mQuit = true;
+		}
+		mWake.notify_one();
+		mThread.join();
+	}
+
+	// Any thread: formats into the ring; drops the record instead of waiting when the ring is full
+	void Write(int level, const char* format, ...)
+	{
+		va_list args;
+		va_start(args, format);
+		WriteV(level, format, args);
+		va_end(args);
+	}
+
+	void WriteV(int level, const char* format, va_list args)
+	{
+		size_t position = mEnqueue.load(std::memory_order_relaxed);
+		Slot* slot;
+		for (;;)
+		{
+			slot = &mSlots[position & (CAPACITY - 1)];
+			size_t sequence = slot->sequence.load(std::memory_order_acquire);
+			ptrdiff_t difference = (ptrdiff_t)sequence - (ptrdiff_t)position;
+			if (difference == 0)
+			{
+				if (mEnqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (difference < 0)
+			{
+				mDropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			else
+				position = mEnqueue.load(std::memory_order_relaxed);
+		}
+
+		slot->level = level;
+		slot->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - mStart).count();
+		vsnprintf(slot->text, MESSAGE_SIZE, format, args);
+		slot->sequence.store(position + 1, std::memory_order_release);
+	}
+
+	unsigned long long Dropped() const { return mDropped.load(std::memory_order_relaxed); }
+
+	static const char* LevelName(int level)
+	{
+		switch (level)
+		{
+		case LOG_LEVEL_DEBUG: return "DEBUG";
+		case LOG_LEVEL_INFO: return "INFO";
+		case LOG_LEVEL_WARNING: return "WARN";
+		case LOG_LEVEL_ERROR: return "ERROR";
+		default: return "?";
+		}
+	}
+
+private:
+	struct Slot
+	{
+		std::atomic<size_t> sequence;
+		int level;
+		double seconds;
+		char text[MESSAGE_SIZE];
+	};
+
+	// Writer thread: drains the ring, flushes when it runs dry, then naps; producers never wake it
+	void Run()
+	{
+		for (;;)
+		{
+			bool wrote = false;
+			while (Drain())
+				wrote = true;
+			if (wrote)
+				fflush(stdout);
+
+			std::unique_lock<std::mutex> lock(mWakeMutex);
+			if (mQuit)
+				break;
+			mWake.wait_for(lock, std::chrono::milliseconds(10));
+		}
+
+		while (Drain())
+			;
+		unsigned long long dropped = mDropped.load(std::memory_order_relaxed);
+		if (dropped != mReportedDropped)
+			fprintf(stdout, "WARN  log ring full, %llu records dropped\n", dropped - mReportedDropped);
+		fflush(stdout);
+	}
+
+	// Writes the oldest complete record; false when there is none
+	bool Drain()
+	{
+		Slot& slot = mSlots[mDequeue & (CAPACITY - 1)];
+		if (slot.sequence.load(std::memory_order_acquire) != mDequeue + 1)
+			return false;
+
+		unsigned long long dropped = mDropped.load(std::memory_order_relaxed);
+		if (dropped != mReportedDropped)
+		{
+			fprintf(stdout, "[%10.3f] WARN  log ring full, %llu records dropped\n", slot.seconds, dropped - mReportedDropped);
+			mReportedDropped = dropped;
+		}
+		fprintf(stdout, "[%10.3f] %-5s %s\n", slot.seconds, LevelName(slot.level), slot.text);
+
+		slot.sequence.store(mDequeue + CAPACITY, std::memory_order_release);
+		++mDequeue;
+		return true;
+	}
+
+	Slot mSlots[CAPACITY];
+	alignas(64) std::atomic<size_t> mEnqueue{ 0 };
+	alignas(64) size_t mDequeue = 0;				// writer thread only
+	std::atomic<unsigned long long> mDropped{ 0 };
+	unsigned long long mReportedDropped = 0;		// writer thread only
+	std::chrono::steady_clock::time_point mStart;
+
+	std::thread mThread;
+	std::mutex mThreadMutex;
+	std::mutex mWakeMutex;
+	std::condition_variable mWake;
+	bool mQuit = false;
+};
+
+inline Logger& ULogger()
+{
+	static Logger logger;
+	return logger;
+}
+
+// Per-call-site limiter for the *_EVERY macros
+class LogRateLimit
+{
+public:
+	bool Allow(double intervalSeconds)
+	{
+		long long now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		long long next = mNext.load(std::memory_order_relaxed);
+		if (now < next)
+			return false;
+		return mNext.compare_exchange_strong(next, now + (long long)(intervalSeconds * 1.0e6), std::memory_order_relaxed);
+	}
+
+private:
+	std::atomic<long long> mNext{ 0 };
+};
+
+#define ULOG_WRITE(Level, ...) ULogger().Write(Level, __VA_ARGS__)
+#define ULOG_WRITE_EVERY(Level, Seconds, ...) do { static LogRateLimit logRateLimit; if (logRateLimit.Allow(Seconds)) ULOG_WRITE(Level, __VA_ARGS__); } while (0)
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_DEBUG
+#define ULOG_DEBUG(...) ULOG_WRITE(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define ULOG_DEBUG_EVERY(Seconds, ...) ULOG_WRITE_EVERY(LOG_LEVEL_DEBUG, Seconds, __VA_ARGS__)
+#else
+#define ULOG_DEBUG(...) ((void)0)
+#define ULOG_DEBUG_EVERY(Seconds, ...) ((void)0)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_INFO
+#define ULOG_INFO(...) ULOG_WRITE(LOG_LEVEL_INFO, __VA_ARGS__)
+#define ULOG_INFO_EVERY(Seconds, ...) ULOG_WRITE_EVERY(LOG_LEVEL_INFO, Seconds, __VA_ARGS__)
+#else
+#define ULOG_INFO(...) ((void)0)
+#define ULOG_INFO_EVERY(Seconds, ...) ((void)0)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_WARNING
+#define ULOG_WARNING(...) ULOG_WRITE(LOG_LEVEL_WARNING, __VA_ARGS__)
+#else
+#define ULOG_WARNING(...) ((void)0)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_ERROR
+#define ULOG_ERROR(...) ULOG_WRITE(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define ULOG_ERROR(...) ((void)0)
+#endif
+
+#endif // LOG_H
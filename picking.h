@@ -0,0 +1,296 @@
+#ifndef PICKING_H
+#define PICKING_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>           // FLT_MAX
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/* Ray picking
+ * -----------
+ * Two levels of bounding volume hierarchies. The scene level is built over the
+ * world-space bounds of every object whenever the scene changes. Each mesh has a triangle
+ * level, built once in the mesh's local space. A pick walks the scene BVH front to back.
+ * For every object box the ray enters, it moves the ray into the object's local space
+ * (the model matrix is inverted on the spot, only for those candidates) and walks that
+ * mesh's triangle BVH. The ray parameter is unchanged by an affine transform, so hits in
+ * different objects compare directly, and boxes farther than the closest hit so far are
+ * skipped.
+ *
+ * Both levels share one builder: median split on the longest centroid axis, nodes in a
+ * flat array with the near child right after its parent.
+ */
+
+class Bvh
+{
+public:
+	struct Node
+	{
+		glm::vec3 boundsMin;
+		uint32_t first;			// leaf: first primitive; inner: right child (left child is the next node)
+		glm::vec3 boundsMax;
+		uint32_t count;			// 0 for inner nodes
+	};
+
+	static const uint32_t LEAF_SIZE = 4;
+
+	void Build(const std::vector<glm::vec3>& boundsMin, const std::vector<glm::vec3>& boundsMax)
+	{
+		uint32_t count = (uint32_t)boundsMin.size();
+		mNodes.clear();
+		mPrimitives.resize(count);
+		mCentroids.resize(count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			mPrimitives[i] = i;
+			mCentroids[i] = (boundsMin[i] + boundsMax[i]) * 0.5f;
+		}
+		if (count == 0)
+			return;
+
+		mNodes.reserve(2 * (count / LEAF_SIZE + 1));
+		BuildNode(boundsMin, boundsMax, 0, count);
+		mCentroids.clear();
+		mCentroids.shrink_to_fit();
+	}
+
+	bool Empty() const { return mNodes.empty(); }
+
+	// Calls test(primitive, tMax) for every leaf primitive whose node the ray enters before tMax;
+	// the test shortens tMax when it finds a closer hit
+	template<typename LeafTest>
+	void Traverse(const glm::vec3& origin, const glm::vec3& direction, float& tMax, LeafTest test) const
+	{
+		if (mNodes.empty())
+			return;
+
+		glm::vec3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+		uint32_t stack[64];
+		float stackDistance[64];
+		int depth = 0;
+		uint32_t node = 0;
+		if (EnterDistance(mNodes[0], origin, inverseDirection, tMax) == FLT_MAX)
+			return;
+
+		for (;;)
+		{
+			const Node& current = mNodes[node];
+			if (current.count > 0)
+			{
+				for (uint32_t i = 0; i < current.count; ++i)
+					test(mPrimitives[current.first + i], tMax);
+			}
+			else
+			{
+				uint32_t near = node + 1;
+				uint32_t far = current.first;
+				float nearDistance = EnterDistance(mNodes[near], origin, inverseDirection, tMax);
+				float farDistance = EnterDistance(mNodes[far], origin, inverseDirection, tMax);
+				if (farDistance < nearDistance)
+				{
+					std::swap(near, far);
+					std::swap(nearDistance, farDistance);
+				}
+
+				if (nearDistance != FLT_MAX)
+				{
+					if (farDistance != FLT_MAX && depth < 64)
+					{
+						stack[depth] = far;
+						stackDistance[depth++] = farDistance;
+					}
+					node = near;
+					continue;
+				}
+			}
+
+			// Skip deferred nodes that start beyond a hit found since they were pushed
+			do
+			{
+				if (depth == 0)
+					return;
+				--depth;
+			} while (stackDistance[depth] > tMax);
+			node = stack[depth];
+		}
+	}
+
+private:
+	// Distance at which the ray enters a node's box, FLT_MAX when it misses or enters past tMax
+	static float EnterDistance(const Node& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float tMax)
+	{
+		float tEnter = 0.0f;
+		float tExit = tMax;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			float t0 = (node.boundsMin[axis] - origin[axis]) * inverseDirection[axis];
+			float t1 = (node.boundsMax[axis] - origin[axis]) * inverseDirection[axis];
+			if (t0 > t1)
+				std::swap(t0, t1);
+			// NaN (a flat box edge-on) compares false and leaves the interval as it is
+			if (t0 > tEnter)
+				tEnter = t0;
+			if (t1 < tExit)
+				tExit = t1;
+		}
+		return tEnter <= tExit ? tEnter : FLT_MAX;
+	}
+
+	uint32_t BuildNode(const std::vector<glm::vec3>& boundsMin, const std::vector<glm::vec3>& boundsMax, uint32_t first, uint32_t count)
+	{
+		uint32_t index = (uint32_t)mNodes.size();
+		mNodes.push_back(Node());
+
+		glm::vec3 nodeMin(FLT_MAX), nodeMax(-FLT_MAX), centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+		for (uint32_t i = first; i < first + count; ++i)
+		{
+			uint32_t primitive = mPrimitives[i];
+			nodeMin = glm::min(nodeMin, boundsMin[primitive]);
+			nodeMax = glm::max(nodeMax, boundsMax[primitive]);
+			centroidMin = glm::min(centroidMin, mCentroids[primitive]);
+			centroidMax = glm::max(centroidMax, mCentroids[primitive]);
+		}
+		mNodes[index].boundsMin = nodeMin;
+		mNodes[index].boundsMax = nodeMax;
+
+		glm::vec3 extent = centroidMax - centroidMin;
+		int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+		if (count <= LEAF_SIZE || extent[axis] <= 0.0f)
+		{
+			mNodes[index].first = first;
+			mNodes[index].count = count;
+			return index;
+		}
+
+		uint32_t half = count / 2;
+		std::nth_element(mPrimitives.begin() + first, mPrimitives.begin() + first + half, mPrimitives.begin() + first + count,
+			[this, axis](uint32_t a, uint32_t b) { return mCentroids[a][axis] < mCentroids[b][axis]; });
+
+		BuildNode(boundsMin, boundsMax, first, half);
+		uint32_t right = BuildNode(boundsMin, boundsMax, first + half, count - half);
+		mNodes[index].first = right;
+		mNodes[index].count = 0;
+		return index;
+	}
+
+	std::vector<Node> mNodes;
+	std::vector<uint32_t> mPrimitives;
+	std::vector<glm::vec3> mCentroids;		// build only
+};
+
+
+// Triangle soup of one mesh in local space, with its BVH
+class PickMesh
+{
+public:
+	void Build(const std::vector<glm::vec3>& triangles)
+	{
+		mTriangles = triangles;
+		size_t count = mTriangles.size() / 3;
+		std::vector<glm::vec3> boundsMin(count), boundsMax(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			boundsMin[i] = glm::min(mTriangles[3 * i], glm::min(mTriangles[3 * i + 1], mTriangles[3 * i + 2]));
+			boundsMax[i] = glm::max(mTriangles[3 * i], glm::max(mTriangles[3 * i + 1], mTriangles[3 * i + 2]));
+		}
+		mBvh.Build(boundsMin, boundsMax);
+	}
+
+	size_t TriangleCount() const { return mTriangles.size() / 3; }
+
+	// Shortens tMax to the closest two-sided triangle hit; true when it did
+	bool Intersect(const glm::vec3& origin, const glm::vec3& direction, float& tMax) const
+	{
+		bool hit = false;
+		mBvh.Traverse(origin, direction, tMax, [&](uint32_t triangle, float& t)
+			{
+				if (IntersectTriangle(origin, direction, mTriangles[3 * triangle], mTriangles[3 * triangle + 1], mTriangles[3 * triangle + 2], t))
+					hit = true;
+			});
+		return hit;
+	}
+
+private:
+	// Moller-Trumbore
+	static bool IntersectTriangle(const glm::vec3& origin, const glm::vec3& direction,
+		const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, float& tMax)
+	{
+		glm::vec3 edge1 = b - a;
+		glm::vec3 edge2 = c - a;
+		glm::vec3 p = glm::cross(direction, edge2);
+		float determinant = glm::dot(edge1, p);
+		if (std::fabs(determinant) < 1.0e-12f)
+			return false;
+
+		float inverse = 1.0f / determinant;
+		glm::vec3 s = origin - a;
+		float u = glm::dot(s, p) * inverse;
+		if (u < 0.0f || u > 1.0f)
+			return false;
+		glm::vec3 q = glm::cross(s, edge1);
+		float v = glm::dot(direction, q) * inverse;
+		if (v < 0.0f || u + v > 1.0f)
+			return false;
+
+		float t = glm::dot(edge2, q) * inverse;
+		if (t <= 0.0f || t >= tMax)
+			return false;
+		tMax = t;
+		return true;
+	}
+
+	std::vector<glm::vec3> mTriangles;		// three vertices per triangle
+	Bvh mBvh;
+};
+
+
+// Scene-level BVH over object bounds; objects are resolved to a model matrix and a PickMesh at pick time
+class ScenePicker
+{
+public:
+	struct Hit
+	{
+		int object = -1;
+		float distance = FLT_MAX;		// along the normalized ray direction
+	};
+
+	void SetObjectBounds(const std::vector<glm::vec3>& boundsMin, const std::vector<glm::vec3>& boundsMax)
+	{
+		mObjects.Build(boundsMin, boundsMax);
+	}
+
+	// objectAt(index, model, mesh) fills the object's model matrix and PickMesh (null to skip the object)
+	template<typename ObjectAccess>
+	Hit Pick(const glm::vec3& origin, const glm::vec3& direction, ObjectAccess objectAt) const
+	{
+		Hit hit;
+		glm::vec3 rayDirection = glm::normalize(direction);
+		float tMax = FLT_MAX;
+		mObjects.Traverse(origin, rayDirection, tMax, [&](uint32_t object, float& t)
+			{
+				glm::mat4 model;
+				const PickMesh* mesh = nullptr;
+				objectAt(object, model, mesh);
+				if (!mesh)
+					return;
+
+				glm::mat4 toLocal = glm::inverse(model);
+				glm::vec3 localOrigin = glm::vec3(toLocal * glm::vec4(origin, 1.0f));
+				glm::vec3 localDirection = glm::vec3(toLocal * glm::vec4(rayDirection, 0.0f));
+				if (mesh->Intersect(localOrigin, localDirection, t))
+				{
+					hit.object = (int)object;
+					hit.distance = t;
+				}
+			});
+		return hit;
+	}
+
+private:
+	Bvh mObjects;
+};
+
+#endif // PICKING_H
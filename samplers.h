@@ -0,0 +1,95 @@
+#ifndef SAMPLERS_H
+#define SAMPLERS_H
+
+#include <GL/glew.h>        // GLEW library
+
+#include <cstring>          // memcmp
+#include <vector>
+
+/* Sampler objects
+ * ---------------
+ * Wrap, filter, anisotropy and border color live in sampler objects bound to texture
+ * units, never in the texture objects, so changing how a texture is sampled does not
+ * mutate (and make the driver revalidate) the texture. SamplerCache creates each distinct
+ * combination once; binding a cached sampler is as cheap as any other bind, so sampling
+ * modes can change per draw.
+ *
+ * The GL_TEXTURE_MAX_ANISOTROPY(_EXT) enum has the same value in core 4.6, the ARB and the
+ * EXT extensions; anisotropy is clamped to what the driver reports and ignored without any
+ * of them.
+ */
+
+struct SamplerDesc
+{
+	GLint wrapS = GL_REPEAT;
+	GLint wrapT = GL_REPEAT;
+	GLint minFilter = GL_LINEAR;
+	GLint magFilter = GL_LINEAR;
+	GLfloat maxAnisotropy = 1.0f;
+	GLfloat borderColor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	bool operator==(const SamplerDesc& other) const
+	{
+		return wrapS == other.wrapS && wrapT == other.wrapT &&
+			minFilter == other.minFilter && magFilter == other.magFilter &&
+			maxAnisotropy == other.maxAnisotropy &&
+			std::memcmp(borderColor, other.borderColor, sizeof(borderColor)) == 0;
+	}
+};
+
+class SamplerCache
+{
+public:
+	void Initialize()
+	{
+		mMaxAnisotropy = 1.0f;
+		if (GLEW_VERSION_4_6 || GLEW_ARB_texture_filter_anisotropic || GLEW_EXT_texture_filter_anisotropic)
+			glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &mMaxAnisotropy);
+	}
+
+	void Destroy()
+	{
+		for (const Entry& entry : mEntries)
+			glDeleteSamplers(1, &entry.sampler);
+		mEntries.clear();
+	}
+
+	// Returns the sampler for a description, creating it on first use
+	GLuint Get(const SamplerDesc& desc)
+	{
+		for (const Entry& entry : mEntries)
+		{
+			if (entry.desc == desc)
+				return entry.sampler;
+		}
+
+		Entry entry;
+		entry.desc = desc;
+		glGenSamplers(1, &entry.sampler);
+		glSamplerParameteri(entry.sampler, GL_TEXTURE_WRAP_S, desc.wrapS);
+		glSamplerParameteri(entry.sampler, GL_TEXTURE_WRAP_T, desc.wrapT);
+		glSamplerParameteri(entry.sampler, GL_TEXTURE_MIN_FILTER, desc.minFilter);
+		glSamplerParameteri(entry.sampler, GL_TEXTURE_MAG_FILTER, desc.magFilter);
+		glSamplerParameterfv(entry.sampler, GL_TEXTURE_BORDER_COLOR, desc.borderColor);
+		if (mMaxAnisotropy > 1.0f)
+			glSamplerParameterf(entry.sampler, GL_TEXTURE_MAX_ANISOTROPY_EXT, desc.maxAnisotropy < mMaxAnisotropy ? desc.maxAnisotropy : mMaxAnisotropy);
+
+		mEntries.push_back(entry);
+		return entry.sampler;
+	}
+
+	// Largest anisotropy the driver supports; 1 when anisotropic filtering is unavailable
+	GLfloat MaxAnisotropy() const { return mMaxAnisotropy; }
+
+private:
+	struct Entry
+	{
+		SamplerDesc desc;
+		GLuint sampler = 0;
+	};
+
+	std::vector<Entry> mEntries;
+	GLfloat mMaxAnisotropy = 1.0f;
+};
+
+#endif // SAMPLERS_H
@@ -0,0 +1,461 @@
+#ifndef SCENEFILE_H
+#define SCENEFILE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include <cfloat>           // FLT_MAX
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>       // modification times
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "log.h"
+
+/* Scene files
+ * -----------
+ * A binary scene (.scn) is a header followed by three flat, 4-byte aligned arrays: textures,
+ * materials and objects. Offsets are counted from the start of the file and the data is
+ * little-endian. Objects reference materials by index and carry their model matrix
+ * together with world-space center and bounds computed when the file was written. That
+ * way the loader only copies records out of the mapping, without per-object math or
+ * allocation. SceneFile maps the file read-only and checks every count, offset and index
+ * once, so callers can trust what it hands out.
+ *
+ * The text form (.scene) is for authoring. It is compiled into a .scn next to it whenever
+ * the .scn is missing or older. One statement per line, '#' starts a comment:
+ *
+ *   texture <unit> <path>
+ *   material <name> [texture <unit>] [multiple] [color r g b a] [ambient strength r g b]
+ *            [light1 r g b x y z] [light2 r g b x y z] [specular i1 size1 i2 size2]
+ *   object <mesh> <material> [static] [scale x y z] [rotate radians x y z] [position x y z]
+ *   light  <mesh> <material> [scale x y z] [rotate radians x y z] [position x y z]
+ *
+ * Static objects never move, so the renderer may bake their diffuse lighting.
+ *
+ * Mesh names and local bounds come from the renderer (SceneMeshInfo).
+ */
+
+const char SCENE_FILE_MAGIC[4] = { 'S', 'C', 'N', 'B' };
+const uint32_t SCENE_FILE_VERSION = 1;
+
+const uint32_t SCENE_MATERIAL_HAS_TEXTURE = 1u << 0;
+const uint32_t SCENE_MATERIAL_MULTIPLE_TEXTURES = 1u << 1;
+const uint32_t SCENE_OBJECT_LIGHT = 1u << 0;
+const uint32_t SCENE_OBJECT_STATIC = 1u << 1;
+
+struct SceneFileHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t textureCount;
+	uint32_t materialCount;
+	uint32_t objectCount;
+	uint32_t textureOffset;
+	uint32_t materialOffset;
+	uint32_t objectOffset;
+};
+
+struct SceneFileTexture
+{
+	int32_t unit;
+	char path[124];				// NUL-terminated
+};
+
+struct SceneFileMaterial
+{
+	int32_t textureUnit;
+	uint32_t flags;				// SCENE_MATERIAL_*
+	float objectColor[4];
+	float ambientColor[3];
+	float ambientStrength;
+	float light1Color[3];
+	float light1Position[3];
+	float light2Color[3];
+	float light2Position[3];
+	float specular[4];			// intensity1, highlightSize1, intensity2, highlightSize2
+};
+
+struct SceneFileObject
+{
+	uint32_t mesh;
+	uint32_t material;
+	uint32_t flags;				// SCENE_OBJECT_*
+	float model[16];			// column-major
+	float center[3];
+	float boundsMin[3];
+	float boundsMax[3];
+};
+
+// A mesh the text form may name, with its local-space bounds
+struct SceneMeshInfo
+{
+	const char* name;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+};
+
+
+// Read-only mapping of a binary scene
+class SceneFile
+{
+public:
+	~SceneFile() { Close(); }
+
+	bool Open(const char* path)
+	{
+		Close();
+		if (!Map(path))
+		{
+			ULOG_ERROR("Failed to map scene file %s", path);
+			return false;
+		}
+		if (!Validate())
+		{
+			ULOG_ERROR("Scene file %s is invalid or from another version", path);
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void Close()
+	{
+#ifdef _WIN32
+		if (mData)
+			UnmapViewOfFile(mData);
+		if (mMapping)
+			CloseHandle(mMapping);
+		if (mFile != INVALID_HANDLE_VALUE)
+			CloseHandle(mFile);
+		mMapping = NULL;
+		mFile = INVALID_HANDLE_VALUE;
+#else
+		if (mData)
+			munmap((void*)mData, mSize);
+#endif
+		mData = nullptr;
+		mSize = 0;
+	}
+
+	const SceneFileHeader& Header() const { return *(const SceneFileHeader*)mData; }
+	const SceneFileTexture* Textures() const { return (const SceneFileTexture*)(mData + Header().textureOffset); }
+	const SceneFileMaterial* Materials() const { return (const SceneFileMaterial*)(mData + Header().materialOffset); }
+	const SceneFileObject* Objects() const { return (const SceneFileObject*)(mData + Header().objectOffset); }
+
+private:
+	bool Map(const char* path)
+	{
+#ifdef _WIN32
+		mFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (mFile == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(mFile, &size) || size.QuadPart == 0)
+			return false;
+		mSize = (size_t)size.QuadPart;
+		mMapping = CreateFileMappingA(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (!mMapping)
+			return false;
+		mData = (const unsigned char*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+		return mData != nullptr;
+#else
+		int file = open(path, O_RDONLY);
+		if (file < 0)
+			return false;
+		struct stat info;
+		if (fstat(file, &info) != 0 || info.st_size == 0)
+		{
+			close(file);
+			return false;
+		}
+		void* data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		close(file);
+		if (data == MAP_FAILED)
+			return false;
+
+		// The loader reads every record once, front to back
+		madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+		mData = (const unsigned char*)data;
+		mSize = (size_t)info.st_size;
+		return true;
+#endif
+	}
+
+	bool SectionFits(uint32_t offset, uint32_t count, size_t recordSize) const
+	{
+		return offset % 4 == 0 && offset >= sizeof(SceneFileHeader) && (uint64_t)offset + (uint64_t)count * recordSize <= mSize;
+	}
+
+	bool Validate() const
+	{
+		if (mSize < sizeof(SceneFileHeader))
+			return false;
+
+		const SceneFileHeader& header = Header();
+		if (std::memcmp(header.magic, SCENE_FILE_MAGIC, 4) != 0 || header.version != SCENE_FILE_VERSION)
+			return false;
+		if (!SectionFits(header.textureOffset, header.textureCount, sizeof(SceneFileTexture)) ||
+			!SectionFits(header.materialOffset, header.materialCount, sizeof(SceneFileMaterial)) ||
+			!SectionFits(header.objectOffset, header.objectCount, sizeof(SceneFileObject)))
+			return false;
+
+		for (uint32_t i = 0; i < header.textureCount; ++i)
+		{
+			if (!std::memchr(Textures()[i].path, '\0', sizeof(Textures()[i].path)))
+				return false;
+		}
+		for (uint32_t i = 0; i < header.objectCount; ++i)
+		{
+			if (Objects()[i].material >= header.materialCount)
+				return false;
+		}
+		return true;
+	}
+
+	const unsigned char* mData = nullptr;
+	size_t mSize = 0;
+#ifdef _WIN32
+	HANDLE mFile = INVALID_HANDLE_VALUE;
+	HANDLE mMapping = NULL;
+#endif
+};
+
+
+// Writes a binary scene; objects must already reference valid materials
+inline bool UWriteSceneFile(const char* path, const std::vector<SceneFileTexture>& textures,
+	const std::vector<SceneFileMaterial>& materials, const std::vector<SceneFileObject>& objects)
+{
+	SceneFileHeader header;
+	std::memcpy(header.magic, SCENE_FILE_MAGIC, 4);
+	header.version = SCENE_FILE_VERSION;
+	header.textureCount = (uint32_t)textures.size();
+	header.materialCount = (uint32_t)materials.size();
+	header.objectCount = (uint32_t)objects.size();
+	header.textureOffset = sizeof(SceneFileHeader);
+	header.materialOffset = header.textureOffset + header.textureCount * sizeof(SceneFileTexture);
+	header.objectOffset = header.materialOffset + header.materialCount * sizeof(SceneFileMaterial);
+
+	FILE* file = fopen(path, "wb");
+	if (!file)
+	{
+		ULOG_ERROR("Failed to write scene file %s", path);
+		return false;
+	}
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(textures.data(), sizeof(SceneFileTexture), textures.size(), file) == textures.size() &&
+		fwrite(materials.data(), sizeof(SceneFileMaterial), materials.size(), file) == materials.size() &&
+		fwrite(objects.data(), sizeof(SceneFileObject), objects.size(), file) == objects.size();
+	written = fclose(file) == 0 && written;
+	if (!written)
+		ULOG_ERROR("Failed to write scene file %s", path);
+	return written;
+}
+
+
+// Fills an object record, transforming the mesh's local bounds into world space
+inline SceneFileObject UMakeSceneFileObject(uint32_t mesh, uint32_t material, uint32_t flags, const glm::mat4& model,
+	const glm::vec3& localMin, const glm::vec3& localMax)
+{
+	SceneFileObject object;
+	object.mesh = mesh;
+	object.material = material;
+	object.flags = flags;
+	std::memcpy(object.model, &model[0][0], sizeof(object.model));
+
+	glm::vec3 center = glm::vec3(model * glm::vec4((localMin + localMax) * 0.5f, 1.0f));
+	glm::vec3 boundsMin(FLT_MAX);
+	glm::vec3 boundsMax(-FLT_MAX);
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		glm::vec3 local((corner & 1) ? localMax.x : localMin.x,
+			(corner & 2) ? localMax.y : localMin.y,
+			(corner & 4) ? localMax.z : localMin.z);
+		glm::vec3 world = glm::vec3(model * glm::vec4(local, 1.0f));
+		boundsMin = glm::min(boundsMin, world);
+		boundsMax = glm::max(boundsMax, world);
+	}
+	for (int i = 0; i < 3; ++i)
+	{
+		object.center[i] = center[i];
+		object.boundsMin[i] = boundsMin[i];
+		object.boundsMax[i] = boundsMax[i];
+	}
+	return object;
+}
+
+
+// Compiles the text form into a binary scene
+inline bool UCompileSceneText(const char* textPath, const char* binaryPath, const SceneMeshInfo* meshes, int meshCount)
+{
+	std::ifstream text(textPath);
+	if (!text)
+	{
+		ULOG_ERROR("Failed to open scene %s", textPath);
+		return false;
+	}
+
+	std::vector<SceneFileTexture> textures;
+	std::vector<SceneFileMaterial> materials;
+	std::vector<SceneFileObject> objects;
+	std::map<std::string, uint32_t> materialIndices;
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(text, line))
+	{
+		++lineNumber;
+		line = line.substr(0, line.find('#'));
+		std::istringstream tokens(line);
+		std::string statement;
+		if (!(tokens >> statement))
+			continue;
+
+		bool valid = true;
+		if (statement == "texture")
+		{
+			SceneFileTexture texture = {};
+			std::string path;
+			valid = (tokens >> texture.unit >> path) && path.size() < sizeof(texture.path);
+			std::strncpy(texture.path, path.c_str(), sizeof(texture.path) - 1);
+			textures.push_back(texture);
+		}
+		else if (statement == "material")
+		{
+			SceneFileMaterial material = {};
+			material.textureUnit = -1;
+			material.objectColor[3] = 1.0f;
+			material.specular[1] = material.specular[3] = 1.0f;
+
+			std::string name, key;
+			valid = (bool)(tokens >> name);
+			while (valid && tokens >> key)
+			{
+				if (key == "texture")
+				{
+					valid = (bool)(tokens >> material.textureUnit);
+					material.flags |= SCENE_MATERIAL_HAS_TEXTURE;
+				}
+				else if (key == "multiple")
+					material.flags |= SCENE_MATERIAL_MULTIPLE_TEXTURES;
+				else if (key == "color")
+					valid = (bool)(tokens >> material.objectColor[0] >> material.objectColor[1] >> material.objectColor[2] >> material.objectColor[3]);
+				else if (key == "ambient")
+					valid = (bool)(tokens >> material.ambientStrength >> material.ambientColor[0] >> material.ambientColor[1] >> material.ambientColor[2]);
+				else if (key == "light1" || key == "light2")
+				{
+					float* color = key == "light1" ? material.light1Color : material.light2Color;
+					float* position = key == "light1" ? material.light1Position : material.light2Position;
+					valid = (bool)(tokens >> color[0] >> color[1] >> color[2] >> position[0] >> position[1] >> position[2]);
+				}
+				else if (key == "specular")
+					valid = (bool)(tokens >> material.specular[0] >> material.specular[1] >> material.specular[2] >> material.specular[3]);
+				else
+					valid = false;
+			}
+			if (valid)
+			{
+				materialIndices[name] = (uint32_t)materials.size();
+				materials.push_back(material);
+			}
+		}
+		else if (statement == "object" || statement == "light")
+		{
+			std::string meshName, materialName, key;
+			valid = (bool)(tokens >> meshName >> materialName);
+
+			int mesh = 0;
+			while (mesh < meshCount && meshName != meshes[mesh].name)
+				++mesh;
+			auto material = materialIndices.find(materialName);
+			valid = valid && mesh < meshCount && material != materialIndices.end();
+
+			glm::vec3 scale(1.0f), axis(0.0f, 1.0f, 0.0f), position(0.0f);
+			float angle = 0.0f;
+			uint32_t flags = statement == "light" ? SCENE_OBJECT_LIGHT : 0;
+			while (valid && tokens >> key)
+			{
+				if (key == "static" && statement == "object")
+					flags |= SCENE_OBJECT_STATIC;
+				else if (key == "scale")
+					valid = (bool)(tokens >> scale.x >> scale.y >> scale.z);
+				else if (key == "rotate")
+					valid = (bool)(tokens >> angle >> axis.x >> axis.y >> axis.z);
+				else if (key == "position")
+					valid = (bool)(tokens >> position.x >> position.y >> position.z);
+				else
+					valid = false;
+			}
+
+			if (valid)
+			{
+				// Model matrix: transformations are applied right-to-left order
+				glm::mat4 model = glm::translate(position) * glm::rotate(angle, axis) * glm::scale(scale);
+				objects.push_back(UMakeSceneFileObject((uint32_t)mesh, material->second, flags,
+					model, meshes[mesh].boundsMin, meshes[mesh].boundsMax));
+			}
+		}
+		else
+			valid = false;
+
+		if (!valid)
+		{
+			ULOG_ERROR("%s:%d: cannot parse '%s'", textPath, lineNumber, line.c_str());
+			return false;
+		}
+	}
+
+	return UWriteSceneFile(binaryPath, textures, materials, objects);
+}
+
+
+// Binary scene path for a scene path: .scene compiles to .scn next to it, anything else is used as is
+inline std::string USceneBinaryPath(const std::string& path)
+{
+	const std::string textExtension = ".scene";
+	if (path.size() > textExtension.size() && path.compare(path.size() - textExtension.size(), textExtension.size(), textExtension) == 0)
+		return path.substr(0, path.size() - textExtension.size()) + ".scn";
+	return path;
+}
+
+
+// Compiles a text scene when its binary is missing or older; true when the binary is up to date
+inline bool UCompileSceneIfStale(const std::string& path, const SceneMeshInfo* meshes, int meshCount)
+{
+	std::string binaryPath = USceneBinaryPath(path);
+	if (binaryPath == path)
+		return true;
+
+	struct stat textInfo, binaryInfo;
+	if (stat(path.c_str(), &textInfo) != 0)
+	{
+		ULOG_ERROR("Failed to open scene %s", path.c_str());
+		return false;
+	}
+	if (stat(binaryPath.c_str(), &binaryInfo) == 0 && binaryInfo.st_mtime >= textInfo.st_mtime)
+		return true;
+
+	ULOG_INFO("Compiling scene %s to %s", path.c_str(), binaryPath.c_str());
+	return UCompileSceneText(path.c_str(), binaryPath.c_str(), meshes, meshCount);
+}
+
+#endif // SCENEFILE_H
@@ -0,0 +1,170 @@
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+
+#include <GL/glew.h>        // GLEW library
+
+#include <algorithm>
+#include <cstring>
+
+#include "log.h"
+
+/* Persistently mapped streaming buffer
+ * ------------------------------------
+ * One immutable buffer (glBufferStorage) is mapped once for the life of the program with
+ * GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT and split into REGION_COUNT frame regions.
+ * Each frame bump-allocates from its own region, and a fence placed at the end of the
+ * frame guards the region until the GPU has consumed it. With three regions the CPU
+ * writes frame N+2 while the GPU still reads frame N; BeginFrame only waits when the GPU
+ * falls more than that far behind. No glBufferSubData or glUniform* upload is involved,
+ * so the driver never has to synchronize or shadow-copy the data.
+ *
+ * Allocations are bound with glBindBufferRange, so every allocation is aligned to the
+ * larger of the uniform and shader storage offset alignments.
+ */
+class StreamBuffer
+{
+public:
+	static const int REGION_COUNT = 3;
+
+	// Pointer for the CPU to write and offset to bind for the GPU to read
+	struct Allocation
+	{
+		void* data;
+		GLintptr offset;
+		GLsizeiptr size;
+	};
+
+	bool Initialize(GLsizeiptr regionSize)
+	{
+		GLint uniformAlignment = 0;
+		GLint storageAlignment = 0;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+		mAlignment = std::max<GLsizeiptr>(std::max(uniformAlignment, storageAlignment), 16);
+
+		return Create(regionSize);
+	}
+
+	void Destroy()
+	{
+		if (!mBuffer)
+			return;
+
+		WaitAll();
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		glDeleteBuffers(1, &mBuffer);
+		mBuffer = 0;
+		mMapped = nullptr;
+	}
+
+	// Moves to the next region, waiting for the GPU to finish the frame that last used it
+	void BeginFrame()
+	{
+		mRegion = (mRegion + 1) % REGION_COUNT;
+		mOffset = 0;
+		Wait(mRegion);
+	}
+
+	// Fences the current region; call after the last command that reads this frame's allocations
+	void EndFrame()
+	{
+		if (mFences[mRegion])
+			glDeleteSync(mFences[mRegion]);
+		mFences[mRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	// Bump-allocates from the current frame's region; data is null when the region is full
+	Allocation Allocate(GLsizeiptr size)
+	{
+		Allocation allocation = { nullptr, 0, size };
+		GLsizeiptr alignedSize = Align(size);
+		if (!mMapped || mOffset + alignedSize > mRegionSize)
+			return allocation;
+
+		allocation.offset = mRegion * mRegionSize + mOffset;
+		allocation.data = mMapped + allocation.offset;
+		mOffset += alignedSize;
+		return allocation;
+	}
+
+	// Allocates and copies in one step
+	Allocation Write(const void* data, GLsizeiptr size)
+	{
+		Allocation allocation = Allocate(size);
+		if (allocation.data)
+			std::memcpy(allocation.data, data, (size_t)size);
+		return allocation;
+	}
+
+	void BindRange(GLenum target, GLuint index, const Allocation& allocation) const
+	{
+		glBindBufferRange(target, index, mBuffer, allocation.offset, allocation.size);
+	}
+
+	GLuint Buffer() const { return mBuffer; }
+
+private:
+	bool Create(GLsizeiptr regionSize)
+	{
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		mRegionSize = Align(regionSize);
+		mOffset = 0;
+
+		glGenBuffers(1, &mBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+		glBufferStorage(GL_COPY_WRITE_BUFFER, mRegionSize * REGION_COUNT, NULL, flags);
+		mMapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, mRegionSize * REGION_COUNT, flags);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		if (!mMapped)
+		{
+			ULOG_ERROR("Failed to map the streaming buffer");
+			glDeleteBuffers(1, &mBuffer);
+			mBuffer = 0;
+			return false;
+		}
+		return true;
+	}
+
+	// Blocks until the GPU has finished with a region
+	void Wait(int region)
+	{
+		if (!mFences[region])
+			return;
+
+		GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		for (;;)
+		{
+			GLenum result = glClientWaitSync(mFences[region], flags, 1000000);	// 1 ms
+			if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED)
+				break;
+			flags = 0;
+		}
+		glDeleteSync(mFences[region]);
+		mFences[region] = 0;
+	}
+
+	void WaitAll()
+	{
+		for (int region = 0; region < REGION_COUNT; ++region)
+			Wait(region);
+	}
+
+	GLsizeiptr Align(GLsizeiptr size) const
+	{
+		return (size + mAlignment - 1) / mAlignment * mAlignment;
+	}
+
+	GLuint mBuffer = 0;
+	unsigned char* mMapped = nullptr;
+	GLsizeiptr mAlignment = 256;
+	GLsizeiptr mRegionSize = 0;
+	GLsizeiptr mOffset = 0;
+	int mRegion = 0;
+	GLsync mFences[REGION_COUNT] = {};
+};
+
+#endif // STREAMBUFFER_H
@@ -0,0 +1,178 @@
+#ifndef STRESSSCENE_H
+#define STRESSSCENE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "scenefile.h"
+#include "log.h"
+
+/* Stress scenes
+ * -------------
+ * Generates a binary scene of any size from the renderer's primitives for scaling tests:
+ * a static ground plane, `objects` randomly placed, rotated and scaled primitives, and `lights`
+ * light objects that the materials take their two lights from. The layout is either
+ * uniform over a square sized to keep `density` objects per square unit, or gathered
+ * into Gaussian clusters. Every value comes from a small explicitly seeded generator,
+ * not the <random> distributions, so a seed yields the same scene on every platform.
+ */
+
+struct StressSceneOptions
+{
+	uint32_t objects = 0;
+	uint32_t seed = 1;
+	float density = 0.25f;				// objects per square unit of ground
+	bool clustered = false;
+	float minScale = 0.2f;
+	float maxScale = 1.0f;
+	float maxHeight = 3.0f;				// objects are placed between the ground and this height
+	uint32_t materials = 32;
+	float texturedFraction = 0.8f;
+	float multipleTextureFraction = 0.1f;
+	uint32_t lights = 8;
+};
+
+// xorshift64* with floats built from the top bits
+class StressRandom
+{
+public:
+	explicit StressRandom(uint64_t seed) : mState(seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+	uint64_t Next()
+	{
+		mState ^= mState >> 12;
+		mState ^= mState << 25;
+		mState ^= mState >> 27;
+		return mState * 0x2545F4914F6CDD1Dull;
+	}
+
+	// [0, 1)
+	float Unit() { return (float)(Next() >> 40) / (float)(1ull << 24); }
+	float Range(float low, float high) { return low + (high - low) * Unit(); }
+	uint32_t Index(uint32_t count) { return (uint32_t)((Next() >> 32) * count >> 32); }
+
+	// Standard normal (Box-Muller)
+	float Normal()
+	{
+		float u = std::max(Unit(), 1.0e-7f);
+		return std::sqrt(-2.0f * std::log(u)) * std::cos(6.2831853f * Unit());
+	}
+
+private:
+	uint64_t mState;
+};
+
+
+// Writes a generated scene that samples the given textures; light objects use the mesh named `lightMesh`
+inline bool UGenerateStressScene(const StressSceneOptions& options, const std::vector<SceneFileTexture>& textures,
+	const SceneMeshInfo* meshes, int meshCount, const char* groundMesh, const char* lightMesh, const char* path)
+{
+	int ground = 0, light = 0;
+	for (int mesh = 0; mesh < meshCount; ++mesh)
+	{
+		if (std::strcmp(meshes[mesh].name, groundMesh) == 0)
+			ground = mesh;
+		if (std::strcmp(meshes[mesh].name, lightMesh) == 0)
+			light = mesh;
+	}
+
+	StressRandom random(options.seed);
+	float extent = 0.5f * std::sqrt(std::max(options.objects, 1u) / std::max(options.density, 1.0e-4f));
+
+	// Light objects hover above the objects
+	std::vector<glm::vec3> lightPositions(std::max(options.lights, 1u));
+	std::vector<glm::vec3> lightColors(lightPositions.size());
+	for (size_t i = 0; i < lightPositions.size(); ++i)
+	{
+		lightPositions[i] = glm::vec3(random.Range(-extent, extent), options.maxHeight + random.Range(1.0f, 3.0f), random.Range(-extent, extent));
+		lightColors[i] = glm::vec3(random.Range(0.2f, 0.6f), random.Range(0.2f, 0.6f), random.Range(0.2f, 0.6f));
+	}
+
+	// Material 0 is the ground's; the others pick a texture, a color and two of the lights
+	std::vector<SceneFileMaterial> materials(std::max(options.materials, 1u) + 1);
+	for (size_t i = 0; i < materials.size(); ++i)
+	{
+		SceneFileMaterial& material = materials[i];
+		std::memset(&material, 0, sizeof(material));
+		material.textureUnit = -1;
+		bool textured = !textures.empty() && (i == 0 || random.Unit() < options.texturedFraction);
+		if (textured)
+		{
+			material.textureUnit = textures[random.Index((uint32_t)textures.size())].unit;
+			material.flags |= SCENE_MATERIAL_HAS_TEXTURE;
+			if (i > 0 && random.Unit() < options.multipleTextureFraction)
+				material.flags |= SCENE_MATERIAL_MULTIPLE_TEXTURES;
+		}
+
+		glm::vec4 color(random.Unit(), random.Unit(), random.Unit(), 1.0f);
+		glm::vec3 light1Position = lightPositions[random.Index((uint32_t)lightPositions.size())];
+		glm::vec3 light2Position = lightPositions[random.Index((uint32_t)lightPositions.size())];
+		glm::vec3 light1Color = lightColors[random.Index((uint32_t)lightColors.size())];
+		glm::vec3 light2Color = lightColors[random.Index((uint32_t)lightColors.size())];
+		for (int c = 0; c < 3; ++c)
+		{
+			material.objectColor[c] = color[c];
+			material.ambientColor[c] = 0.4f;
+			material.light1Color[c] = light1Color[c];
+			material.light1Position[c] = light1Position[c];
+			material.light2Color[c] = light2Color[c];
+			material.light2Position[c] = light2Position[c];
+		}
+		material.objectColor[3] = 1.0f;
+		material.ambientStrength = random.Range(0.4f, 0.9f);
+		material.specular[0] = random.Range(0.0f, 1.5f);
+		material.specular[1] = random.Range(2.0f, 16.0f);
+		material.specular[2] = random.Range(0.0f, 0.5f);
+		material.specular[3] = random.Range(2.0f, 16.0f);
+	}
+
+	std::vector<SceneFileObject> objects;
+	objects.reserve((size_t)options.objects + lightPositions.size() + 1);
+
+	// Static ground under the whole layout
+	glm::mat4 groundModel = glm::scale(glm::vec3(extent + 1.0f, 1.0f, extent + 1.0f));
+	objects.push_back(UMakeSceneFileObject((uint32_t)ground, 0, SCENE_OBJECT_STATIC, groundModel, meshes[ground].boundsMin, meshes[ground].boundsMax));
+
+	// Cluster centers, about a thousand objects each
+	std::vector<glm::vec3> clusters(options.clustered ? options.objects / 1000 + 1 : 0);
+	for (glm::vec3& center : clusters)
+		center = glm::vec3(random.Range(-extent, extent), 0.0f, random.Range(-extent, extent));
+	float clusterSpread = extent / std::sqrt((float)std::max<size_t>(clusters.size(), 1)) * 0.25f;
+
+	for (uint32_t i = 0; i < options.objects; ++i)
+	{
+		uint32_t mesh = random.Index((uint32_t)meshCount);
+		uint32_t material = 1 + random.Index((uint32_t)materials.size() - 1);
+
+		glm::vec3 position;
+		if (clusters.empty())
+			position = glm::vec3(random.Range(-extent, extent), 0.0f, random.Range(-extent, extent));
+		else
+		{
+			const glm::vec3& center = clusters[random.Index((uint32_t)clusters.size())];
+			position = center + glm::vec3(random.Normal(), 0.0f, random.Normal()) * clusterSpread;
+		}
+		position.y = random.Range(0.0f, options.maxHeight);
+
+		float scale = random.Range(options.minScale, options.maxScale);
+		float angle = random.Range(0.0f, 6.2831853f);
+		glm::mat4 model = glm::translate(position) * glm::rotate(angle, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::scale(glm::vec3(scale));
+		objects.push_back(UMakeSceneFileObject(mesh, material, 0, model, meshes[mesh].boundsMin, meshes[mesh].boundsMax));
+	}
+
+	for (const glm::vec3& position : lightPositions)
+	{
+		glm::mat4 model = glm::translate(position) * glm::scale(glm::vec3(0.4f));
+		objects.push_back(UMakeSceneFileObject((uint32_t)light, 0, SCENE_OBJECT_LIGHT, model, meshes[light].boundsMin, meshes[light].boundsMax));
+	}
+
+	return UWriteSceneFile(path, textures, materials, objects);
+}
+
+#endif // STRESSSCENE_H
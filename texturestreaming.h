@@ -0,0 +1,318 @@
+#ifndef TEXTURESTREAMING_H
+#define TEXTURESTREAMING_H
+
+#include <GL/glew.h>        // GLEW library
+
+#include <algorithm>
+#include <climits>          // ULLONG_MAX
+#include <cmath>            // log2
+#include <vector>
+
+#include "log.h"
+
+/* Texture streaming
+ * -----------------
+ * Every streamed texture keeps its full mip chain in system memory (built once with a box
+ * filter when it is added) and only a suffix of it on the GPU: levels top..last, allocated
+ * as an immutable texture of exactly that size. At first only the mips up to
+ * MinResidentSize are uploaded, so textures can be drawn right away at low detail.
+ *
+ * Each frame the renderer reports how many texels across each texture covers on screen.
+ * Update() then moves each texture's top level one mip at a time toward the finest level
+ * it needs, coarse to fine. The upload per frame is capped, so streaming never stalls a
+ * frame. When a finer level would go over BudgetBytes, mips are evicted first from
+ * textures that have more detail than they currently need, then from the least recently
+ * used ones. Changing the top level reallocates the texture, copies the levels it keeps
+ * on the GPU with glCopyImageSubData, uploads the new ones and rebinds the texture unit.
+ *
+ * GPU sizes are counted at 4 bytes per texel; drivers pad RGB8 to that anyway.
+ */
+class TextureStreamer
+{
+public:
+	// Texture memory the streamed textures may occupy, and how much may be uploaded per frame
+	size_t BudgetBytes = 64 * 1024 * 1024;
+	size_t UploadBytesPerFrame = 4 * 1024 * 1024;
+
+	// Mips up to this size are uploaded when a texture is added and never evicted
+	int MinResidentSize = 64;
+
+	// Copies tightly packed 8-bit RGB or RGBA pixels, builds their mip chain and binds the coarse mips to a unit
+	bool Add(int unit, const unsigned char* pixels, int width, int height, int channels)
+	{
+		if (channels != 3 && channels != 4)
+		{
+			ULOG_ERROR("Not implemented to handle image with %d channels", channels);
+			return false;
+		}
+
+		Texture texture;
+		texture.unit = unit;
+		texture.channels = channels;
+		texture.internalFormat = channels == 4 ? GL_RGBA8 : GL_RGB8;
+		texture.format = channels == 4 ? GL_RGBA : GL_RGB;
+
+		Level level;
+		level.width = width;
+		level.height = height;
+		level.pixels.assign(pixels, pixels + (size_t)width * height * channels);
+		texture.levels.push_back(level);
+		while (level.width > 1 || level.height > 1)
+		{
+			level = Downsample(level, channels);
+			texture.levels.push_back(level);
+		}
+
+		texture.minTop = (int)texture.levels.size() - 1;
+		for (int i = 0; i < (int)texture.levels.size(); ++i)
+		{
+			if (std::max(texture.levels[i].width, texture.levels[i].height) <= MinResidentSize)
+			{
+				texture.minTop = i;
+				break;
+			}
+		}
+		texture.wantedTop = texture.minTop;
+
+		mTextures.push_back(texture);
+		SetResidentTop(mTextures.back(), texture.minTop);
+		return true;
+	}
+
+	void Destroy()
+	{
+		for (Texture& texture : mTextures)
+		{
+			if (texture.texture)
+				glDeleteTextures(1, &texture.texture);
+		}
+		mTextures.clear();
+	}
+
+	// The texture on a unit spans about this many texels across on screen this frame
+	void Request(int unit, float screenTexels)
+	{
+		Texture* texture = Find(unit);
+		if (!texture)
+			return;
+
+		const Level& base = texture->levels[0];
+		float ratio = (float)std::max(base.width, base.height) / std::max(screenTexels, 1.0f);
+		int level = ratio > 1.0f ? (int)std::log2(ratio) : 0;
+		texture->wantedTop = std::min(texture->wantedTop, std::min(level, texture->minTop));
+		texture->lastUsed = mFrame;
+	}
+
+	// Streams toward this frame's requests within the budgets; true while uploads are still pending
+	bool Update()
+	{
+		// The budget may have been lowered
+		while (ResidentBytes() > BudgetBytes && EvictOne(nullptr, ULLONG_MAX))
+			;
+
+		// Largest shortfall first
+		std::vector<Texture*> order;
+		for (Texture& texture : mTextures)
+		{
+			if (texture.residentTop > texture.wantedTop)
+				order.push_back(&texture);
+		}
+		std::sort(order.begin(), order.end(), [](const Texture* a, const Texture* b)
+			{ return a->residentTop - a->wantedTop > b->residentTop - b->wantedTop; });
+
+		bool pending = false;
+		size_t uploaded = 0;
+		for (Texture* texture : order)
+		{
+			while (texture->residentTop > texture->wantedTop)
+			{
+				size_t cost = texture->levels[texture->residentTop - 1].GpuBytes();
+				if (uploaded > 0 && uploaded + cost > UploadBytesPerFrame)
+				{
+					pending = true;
+					break;
+				}
+
+				// Make room from textures that need their mips less than this one does
+				bool fits = true;
+				while (ResidentBytes() + cost > BudgetBytes)
+				{
+					if (!EvictOne(texture, texture->lastUsed))
+					{
+						fits = false;
+						break;
+					}
+				}
+				if (!fits)
+				{
+					ULOG_DEBUG_EVERY(1.0, "Texture budget reached: unit %d held at mip %d of wanted %d", texture->unit, texture->residentTop, texture->wantedTop);
+					break;
+				}
+
+				SetResidentTop(*texture, texture->residentTop - 1);
+				uploaded += cost;
+			}
+			if (pending)
+				break;
+		}
+
+		// Requests are per frame
+		for (Texture& texture : mTextures)
+			texture.wantedTop = texture.minTop;
+		++mFrame;
+
+		return pending;
+	}
+
+	size_t ResidentBytes() const
+	{
+		size_t bytes = 0;
+		for (const Texture& texture : mTextures)
+			bytes += texture.ResidentBytes();
+		return bytes;
+	}
+
+	void LogResidency() const
+	{
+		ULOG_INFO("Streamed textures: %.1f of %.1f MB resident", ResidentBytes() / 1048576.0, BudgetBytes / 1048576.0);
+		for (const Texture& texture : mTextures)
+		{
+			const Level& top = texture.levels[texture.residentTop];
+			ULOG_INFO("  unit %d: %dx%d (mip %d), %.1f MB", texture.unit, top.width, top.height, texture.residentTop, texture.ResidentBytes() / 1048576.0);
+		}
+	}
+
+private:
+	struct Level
+	{
+		int width = 0;
+		int height = 0;
+		std::vector<unsigned char> pixels;
+
+		size_t GpuBytes() const { return (size_t)width * height * 4; }
+	};
+
+	struct Texture
+	{
+		int unit = 0;
+		int channels = 0;
+		GLenum internalFormat = GL_RGBA8;
+		GLenum format = GL_RGBA;
+		std::vector<Level> levels;			// full chain in system memory
+		GLuint texture = 0;					// levels residentTop..last
+		int residentTop = 0;
+		int minTop = 0;						// coarsest top level; always resident
+		int wantedTop = 0;					// finest level requested this frame
+		unsigned long long lastUsed = 0;	// frame of the last request
+
+		size_t ResidentBytes() const
+		{
+			size_t bytes = 0;
+			for (int i = residentTop; i < (int)levels.size(); ++i)
+				bytes += levels[i].GpuBytes();
+			return bytes;
+		}
+	};
+
+	static Level Downsample(const Level& source, int channels)
+	{
+		Level level;
+		level.width = std::max(1, source.width / 2);
+		level.height = std::max(1, source.height / 2);
+		level.pixels.resize((size_t)level.width * level.height * channels);
+
+		for (int y = 0; y < level.height; ++y)
+		{
+			int y0 = std::min(2 * y, source.height - 1);
+			int y1 = std::min(2 * y + 1, source.height - 1);
+			for (int x = 0; x < level.width; ++x)
+			{
+				int x0 = std::min(2 * x, source.width - 1);
+				int x1 = std::min(2 * x + 1, source.width - 1);
+				for (int c = 0; c < channels; ++c)
+				{
+					int sum = source.pixels[((size_t)y0 * source.width + x0) * channels + c]
+						+ source.pixels[((size_t)y0 * source.width + x1) * channels + c]
+						+ source.pixels[((size_t)y1 * source.width + x0) * channels + c]
+						+ source.pixels[((size_t)y1 * source.width + x1) * channels + c];
+					level.pixels[((size_t)y * level.width + x) * channels + c] = (unsigned char)((sum + 2) / 4);
+				}
+			}
+		}
+		return level;
+	}
+
+	Texture* Find(int unit)
+	{
+		for (Texture& texture : mTextures)
+		{
+			if (texture.unit == unit)
+				return &texture;
+		}
+		return nullptr;
+	}
+
+	// Drops the top mip of the best candidate: surplus detail first, then the least recently used
+	// texture requested before `lastUsed`. False when nothing may be evicted.
+	bool EvictOne(const Texture* exclude, unsigned long long lastUsed)
+	{
+		Texture* victim = nullptr;
+		bool victimSurplus = false;
+		for (Texture& texture : mTextures)
+		{
+			if (&texture == exclude || texture.residentTop >= texture.minTop)
+				continue;
+
+			bool surplus = texture.residentTop < texture.wantedTop;
+			if (!surplus && texture.lastUsed >= lastUsed)
+				continue;
+
+			if (!victim || (surplus && !victimSurplus) || (surplus == victimSurplus && texture.lastUsed < victim->lastUsed))
+			{
+				victim = &texture;
+				victimSurplus = surplus;
+			}
+		}
+
+		if (!victim)
+			return false;
+
+		SetResidentTop(*victim, victim->residentTop + 1);
+		return true;
+	}
+
+	// Reallocates a texture with `top` as its base level, keeping the mips both allocations share on the GPU
+	void SetResidentTop(Texture& texture, int top)
+	{
+		int levelCount = (int)texture.levels.size() - top;
+		const Level& base = texture.levels[top];
+
+		GLuint replacement = 0;
+		glGenTextures(1, &replacement);
+		glActiveTexture(GL_TEXTURE0 + texture.unit);
+		glBindTexture(GL_TEXTURE_2D, replacement);
+		glTexStorage2D(GL_TEXTURE_2D, levelCount, texture.internalFormat, base.width, base.height);
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		for (int i = top; i < (int)texture.levels.size(); ++i)
+		{
+			const Level& level = texture.levels[i];
+			if (texture.texture && i >= texture.residentTop)
+				glCopyImageSubData(texture.texture, GL_TEXTURE_2D, i - texture.residentTop, 0, 0, 0,
+					replacement, GL_TEXTURE_2D, i - top, 0, 0, 0, level.width, level.height, 1);
+			else
+				glTexSubImage2D(GL_TEXTURE_2D, i - top, 0, 0, level.width, level.height, texture.format, GL_UNSIGNED_BYTE, level.pixels.data());
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		if (texture.texture)
+			glDeleteTextures(1, &texture.texture);
+		texture.texture = replacement;
+		texture.residentTop = top;
+	}
+
+	std::vector<Texture> mTextures;
+	unsigned long long mFrame = 1;
+};
+
+#endif // TEXTURESTREAMING_H
@@ -0,0 +1,56 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+/* Lock-free single-producer / single-consumer triple buffer
+ * ---------------------------------------------------------
+ * The producer always owns one slot (back) and the consumer one slot (front); the third
+ * slot (middle) is handed between them with one atomic exchange. Publishing swaps the
+ * freshly written back slot into the middle, and the consumer swaps the middle into the
+ * front only when a new value is waiting, so neither side ever blocks or sees a slot
+ * that is being written. Intermediate values are dropped when the producer runs ahead.
+ *
+ * Slots are reused, so a slot returned by WriteBuffer() still holds the value written two
+ * publishes ago; producers may use that to skip copying data that has not changed.
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+	// Producer: the slot to fill before Publish()
+	T& WriteBuffer() { return mSlots[mBack]; }
+
+	// Producer: makes the written slot the newest value
+	void Publish()
+	{
+		uint8_t previous = mMiddle.exchange((uint8_t)(mBack | NEW_VALUE), std::memory_order_acq_rel);
+		mBack = previous & INDEX_MASK;
+	}
+
+	// Consumer: moves to the newest published value; returns false if there is none since the last call
+	bool Update()
+	{
+		if (!(mMiddle.load(std::memory_order_relaxed) & NEW_VALUE))
+			return false;
+
+		uint8_t previous = mMiddle.exchange(mFront, std::memory_order_acq_rel);
+		mFront = previous & INDEX_MASK;
+		return true;
+	}
+
+	// Consumer: the value picked up by the last successful Update()
+	const T& ReadBuffer() const { return mSlots[mFront]; }
+
+private:
+	static const uint8_t INDEX_MASK = 0x3;
+	static const uint8_t NEW_VALUE = 0x4;
+
+	T mSlots[3];
+	std::atomic<uint8_t> mMiddle{ 1 };
+	uint8_t mBack = 2;		// producer only
+	uint8_t mFront = 0;		// consumer only
+};
+
+#endif // TRIPLEBUFFER_H